@@ -0,0 +1,111 @@
+#include "ContentCache.h"
+
+namespace rootdiff {
+
+/**
+ * Lookups of the current thread
+ */
+static thread_local CacheStats tl_stats;
+
+/**
+ * Approximate memory taken by one entry: the list node with its key,
+ * value and two links, and the hash table node with its key, iterator,
+ * link and bucket
+ */
+static const Long64_t entry_bytes = 128;
+
+/**
+ * Fingerprint standing for "no second fingerprint" in the keys of hashes
+ */
+static const Fingerprint no_fp = {-1, 0};
+
+ContentCache &ContentCache::instance() {
+  static ContentCache cache;
+  return cache;
+}
+
+void ContentCache::set_capacity(Long64_t bytes) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  capacity_ = bytes;
+  while (!lru_.empty() and (Long64_t)lru_.size() * entry_bytes > capacity_) {
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+    evictions_++;
+  }
+}
+
+bool ContentCache::get(const Key &key, uint64_t &value) {
+  if (!enabled()) return false;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    stats_.misses++;
+    tl_stats.misses++;
+    return false;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second);
+  value = it->second->value;
+  stats_.hits++;
+  tl_stats.hits++;
+  return true;
+}
+
+void ContentCache::put(const Key &key, uint64_t value) {
+  if (!enabled()) return;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  auto it = index_.find(key);
+  if (it != index_.end()) {
+    it->second->value = value;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return;
+  }
+
+  lru_.push_front({key, value});
+  index_[key] = lru_.begin();
+  while ((Long64_t)lru_.size() * entry_bytes > capacity_) {
+    index_.erase(lru_.back().key);
+    lru_.pop_back();
+    evictions_++;
+  }
+}
+
+bool ContentCache::uncomprs_hash(const Fingerprint &fp, uint64_t &hash) {
+  return get({fp, no_fp}, hash);
+}
+
+void ContentCache::set_uncomprs_hash(const Fingerprint &fp, uint64_t hash) {
+  put({fp, no_fp}, hash);
+}
+
+bool ContentCache::verdict(const Fingerprint &fp_1, const Fingerprint &fp_2,
+                           bool &equal) {
+  // the order of the two payloads does not matter
+  Key key = fp_2 < fp_1 ? Key{fp_2, fp_1} : Key{fp_1, fp_2};
+  uint64_t value;
+  if (!get(key, value)) return false;
+  equal = value == 1;
+  return true;
+}
+
+void ContentCache::set_verdict(const Fingerprint &fp_1,
+                               const Fingerprint &fp_2, bool equal) {
+  Key key = fp_2 < fp_1 ? Key{fp_2, fp_1} : Key{fp_1, fp_2};
+  put(key, equal ? 1 : 0);
+}
+
+CacheStats ContentCache::stats() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return stats_;
+}
+
+Long64_t ContentCache::evictions() {
+  std::lock_guard<std::mutex> lock(mtx_);
+  return evictions_;
+}
+
+CacheStats ContentCache::thread_stats() { return tl_stats; }
+
+}  // namespace rootdiff
@@ -0,0 +1,155 @@
+#ifndef ROOT_DIFF_CONTENT_CACHE
+#define ROOT_DIFF_CONTENT_CACHE
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "RtypesCore.h"
+
+/**
+ * Default memory cap of the content cache
+ */
+#define CONTENT_CACHE_BYTES (64LL << 20)
+
+namespace rootdiff {
+
+/**
+ * Length and hash of a payload as stored in a file
+ */
+struct Fingerprint {
+  Long64_t len;
+  uint64_t hash;
+
+  bool operator==(const Fingerprint &other) const {
+    return len == other.len and hash == other.hash;
+  }
+  bool operator<(const Fingerprint &other) const {
+    return len < other.len or (len == other.len and hash < other.hash);
+  }
+};
+
+/**
+ * Lookups of the content cache
+ */
+struct CacheStats {
+  Long64_t hits{0};
+  Long64_t misses{0};
+
+  /// was the cache looked up at all? It is not in CC mode
+  bool used() const { return hits + misses > 0; }
+
+  void merge(const CacheStats &other) {
+    hits += other.hits;
+    misses += other.misses;
+  }
+};
+
+/**
+ * Process-wide cache of what is known about stored payloads
+ *
+ * Payloads are identified by their fingerprint, so an object that recurs
+ * in many files (StreamerInfo, common histograms, baskets carried over
+ * between campaigns) is decompressed and compared only once. The cache
+ * remembers the hash of the decompressed payload of a fingerprint and
+ * whether the payloads of two fingerprints are equal. The least recently
+ * used entries are evicted once the cache holds more than its memory cap.
+ * It can be used by several threads at once.
+ */
+class ContentCache {
+ public:
+  /**
+   * The cache shared by every comparison of the process
+   */
+  static ContentCache &instance();
+
+  /**
+   * Set the memory cap in bytes, 0 disables the cache
+   */
+  void set_capacity(Long64_t bytes);
+
+  /// are lookups worth computing fingerprints for?
+  bool enabled() const { return capacity_ > 0; }
+
+  /**
+   * Look up the hash of the decompressed payload of a fingerprint
+   *
+   * @return false if it is not known
+   */
+  bool uncomprs_hash(const Fingerprint &fp, uint64_t &hash);
+
+  /**
+   * Remember the hash of the decompressed payload of a fingerprint
+   */
+  void set_uncomprs_hash(const Fingerprint &fp, uint64_t hash);
+
+  /**
+   * Look up whether the decompressed payloads of two fingerprints are equal
+   *
+   * @return false if it is not known
+   */
+  bool verdict(const Fingerprint &fp_1, const Fingerprint &fp_2, bool &equal);
+
+  /**
+   * Remember whether the decompressed payloads of two fingerprints are equal
+   */
+  void set_verdict(const Fingerprint &fp_1, const Fingerprint &fp_2,
+                   bool equal);
+
+  /// lookups by every thread so far
+  CacheStats stats();
+
+  /// number of entries evicted so far
+  Long64_t evictions();
+
+  /**
+   * Lookups by the calling thread so far, to tell apart the lookups of
+   * comparisons running on other threads
+   */
+  static CacheStats thread_stats();
+
+ private:
+  /// a fingerprint, or a pair of fingerprints for a verdict
+  struct Key {
+    Fingerprint fp_1;
+    Fingerprint fp_2;
+
+    bool operator==(const Key &other) const {
+      return fp_1 == other.fp_1 and fp_2 == other.fp_2;
+    }
+  };
+
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      return key.fp_1.hash ^ (key.fp_2.hash * 0x9e3779b97f4a7c15ULL) ^
+             key.fp_1.len;
+    }
+  };
+
+  struct Entry {
+    Key key;
+    /// hash of the decompressed payload, or 1 if the payloads are equal
+    uint64_t value;
+  };
+
+  typedef std::list<Entry>::iterator EntryIt;
+
+  ContentCache() : capacity_(CONTENT_CACHE_BYTES) {}
+
+  bool get(const Key &key, uint64_t &value);
+  void put(const Key &key, uint64_t value);
+
+ private:
+  std::mutex mtx_;
+  Long64_t capacity_;
+  /// entries from the most to the least recently used
+  std::list<Entry> lru_;
+  std::unordered_map<Key, EntryIt, KeyHash> index_;
+  CacheStats stats_;
+  Long64_t evictions_{0};
+};
+
+}  // namespace rootdiff
+
+#endif
@@ -0,0 +1,319 @@
+#include "DirComparer.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+#include "Progress.h"
+#include "TROOT.h"
+#include "ThreadPool.h"
+
+namespace rootdiff {
+
+/**
+ * State of the comparison of one pair of files, shared by its tasks
+ */
+struct FileJob {
+  std::string fn_1;
+  std::string fn_2;
+  FileReport report;
+  Timer tmr;
+  CompareStats stats;
+  std::vector<ObjectPair> objs_pair;
+  /// index of the first object pair of every chunk, plus the end
+  std::vector<std::size_t> bounds;
+  std::ostringstream match_log;
+  std::vector<std::string> chunk_logs;
+  std::vector<CompareStats> chunk_stats;
+  std::atomic<int> chunks_left{0};
+  /// complete log of the pair, filled once the last chunk is done
+  std::string log;
+};
+
+/**
+ * Recursively collect the root files below a directory
+ *
+ * Symbolic links are followed, a directory reached again through one is
+ * only listed the first time so that a link loop ends.
+ *
+ * @param[in] top Directory being listed
+ * @param[in] rel Path of the current subdirectory relative to top
+ * @param[out] files Relative paths of the root files
+ * @param[in,out] visited Device and inode of the directories listed so far
+ */
+static void list_root_files(const std::string &top, const std::string &rel,
+                            std::set<std::string> &files,
+                            std::set<std::pair<dev_t, ino_t>> &visited) {
+  std::string path = rel.empty() ? top : top + "/" + rel;
+  struct stat dir_st;
+  if (stat(path.c_str(), &dir_st) == 0 and
+      !visited.insert({dir_st.st_dev, dir_st.st_ino}).second) {
+    return;
+  }
+
+  DIR *dir = opendir(path.c_str());
+  if (!dir) {
+    std::cerr << "Cannot open directory " << path << std::endl;
+    throw std::exception();
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name(entry->d_name);
+    if (name == "." or name == "..") continue;
+
+    std::string entry_rel = rel.empty() ? name : rel + "/" + name;
+    struct stat st;
+    if (stat((top + "/" + entry_rel).c_str(), &st) != 0) continue;
+
+    if (S_ISDIR(st.st_mode)) {
+      list_root_files(top, entry_rel, files, visited);
+    } else if (S_ISREG(st.st_mode) and name.size() > 5 and
+               name.compare(name.size() - 5, 5, ".root") == 0) {
+      files.insert(entry_rel);
+    }
+  }
+  closedir(dir);
+}
+
+static Long64_t file_size(const std::string &fn) {
+  struct stat st;
+  if (stat(fn.c_str(), &st) != 0) return 0;
+  return st.st_size;
+}
+
+/**
+ * Report a pair that cannot be compared as the progress of the run
+ */
+static void report_failure(const FileComparer &comparer, const FileJob &job) {
+  Progress *progress = comparer.progress();
+  if (!progress) return;
+  progress->lower_level(AgreeLevel::Not_eq);
+  progress->difference(job.report.rel_path + ": " + job.report.note);
+}
+
+/**
+ * Combine the chunk results of a pair once its last chunk is done
+ */
+static void finish(const FileComparer &comparer, FileJob &job) {
+  for (auto const &s : job.chunk_stats) job.stats.merge_content(s);
+
+  std::ostringstream log_f;
+  log_f << job.match_log.str();
+  for (auto const &l : job.chunk_logs) log_f << l;
+  comparer.summarize(log_f, job.stats, job.tmr.elapsed());
+  job.log = log_f.str();
+
+  job.report.level = job.stats.level();
+  job.report.seconds = job.tmr.elapsed();
+}
+
+/**
+ * Compare the object pairs of one chunk of a file pair
+ */
+static void compare_chunk(const FileComparer &comparer,
+                          const ObjectComparer &obj_comp, FileJob &job,
+                          std::size_t i_chunk, RootFile &f_1, RootFile &f_2) {
+  std::ostringstream log_f;
+  try {
+    comparer.compare_pairs(obj_comp, f_1, f_2,
+                           job.objs_pair.begin() + job.bounds[i_chunk],
+                           job.objs_pair.begin() + job.bounds[i_chunk + 1],
+                           log_f, job.chunk_stats[i_chunk]);
+  } catch (...) {
+    log_f << "Failed to compare chunk " << i_chunk << " of " << job.fn_1
+          << " and " << job.fn_2 << std::endl;
+    job.chunk_stats[i_chunk].tolerant_eq = false;
+    job.chunk_stats[i_chunk].strict_eq = false;
+    job.chunk_stats[i_chunk].exact_eq = false;
+  }
+  job.chunk_logs[i_chunk] = log_f.str();
+  job.chunk_stats[i_chunk].io_1.merge(f_1.io().stats());
+  job.chunk_stats[i_chunk].io_2.merge(f_2.io().stats());
+
+  if (--job.chunks_left == 0) finish(comparer, job);
+}
+
+AgreeLevel DirComparer::comp(const std::string &dir_1,
+                             const std::string &dir_2,
+                             const std::string &mode,
+                             const std::string &log_fn,
+                             const std::set<std::string> &ignored_classes,
+                             std::vector<FileReport> &reports,
+                             double &seconds) const {
+  ObjectComparer obj_comp = comparer_.make_obj_comparer(mode);
+
+  std::set<std::string> files_1, files_2;
+  std::set<std::pair<dev_t, ino_t>> visited_1, visited_2;
+  list_root_files(dir_1, "", files_1, visited_1);
+  list_root_files(dir_2, "", files_2, visited_2);
+
+  std::set<std::string> all_files(files_1);
+  all_files.insert(files_2.begin(), files_2.end());
+
+  // Files are opened and read from several threads at once
+  ROOT::EnableThreadSafety();
+
+  Timer tmr;
+
+  std::vector<std::unique_ptr<FileJob>> jobs;
+  {
+    ThreadPool pool(n_threads_);
+
+    for (auto const &rel : all_files) {
+      jobs.emplace_back(new FileJob);
+      FileJob *job = jobs.back().get();
+      job->fn_1 = dir_1 + "/" + rel;
+      job->fn_2 = dir_2 + "/" + rel;
+      job->report.rel_path = rel;
+      job->report.level = AgreeLevel::Not_eq;
+      job->report.bytes = file_size(job->fn_1) + file_size(job->fn_2);
+      job->report.seconds = 0.;
+
+      if (files_1.find(rel) == files_1.end()) {
+        job->report.note = "missing in " + dir_1;
+        report_failure(comparer_, *job);
+        continue;
+      }
+      if (files_2.find(rel) == files_2.end()) {
+        job->report.note = "missing in " + dir_2;
+        report_failure(comparer_, *job);
+        continue;
+      }
+
+      pool.submit([this, job, obj_comp, &ignored_classes, &pool] {
+        job->tmr.reset();
+        try {
+          RootFile f_1 = comparer_.open(job->fn_1);
+          RootFile f_2 = comparer_.open(job->fn_2);
+          if (!comparer_.match(f_1, f_2, ignored_classes, job->match_log,
+                               job->objs_pair, job->stats)) {
+            job->report.note = "cannot read record headers";
+            report_failure(comparer_, *job);
+            return;
+          }
+
+          // Split the object pairs into chunks of about CHUNK_BYTES
+          Long64_t chunk_bytes = 0;
+          job->bounds.push_back(0);
+          for (std::size_t i = 0; i < job->objs_pair.size(); i++) {
+            chunk_bytes += job->objs_pair[i].first.nbytes;
+            if (chunk_bytes >= CHUNK_BYTES and i + 1 < job->objs_pair.size()) {
+              job->bounds.push_back(i + 1);
+              chunk_bytes = 0;
+            }
+          }
+          job->bounds.push_back(job->objs_pair.size());
+
+          std::size_t n_chunks = job->bounds.size() - 1;
+          job->chunk_logs.resize(n_chunks);
+          job->chunk_stats.resize(n_chunks);
+          job->chunks_left = n_chunks;
+
+          // Hand the other chunks to the pool, each opening its own files,
+          // and compare the first one with the files we already have open
+          for (std::size_t i = 1; i < n_chunks; i++) {
+            pool.submit([this, job, obj_comp, i] {
+              try {
+                RootFile f_1 = comparer_.open(job->fn_1);
+                RootFile f_2 = comparer_.open(job->fn_2);
+                compare_chunk(comparer_, obj_comp, *job, i, f_1, f_2);
+              } catch (...) {
+                job->chunk_logs[i] = "Failed to open " + job->fn_1 + " and " +
+                                     job->fn_2 + " for chunk " +
+                                     std::to_string(i) + "\n";
+                job->chunk_stats[i].tolerant_eq = false;
+                job->chunk_stats[i].strict_eq = false;
+                job->chunk_stats[i].exact_eq = false;
+                if (--job->chunks_left == 0) finish(comparer_, *job);
+              }
+            });
+          }
+          compare_chunk(comparer_, obj_comp, *job, 0, f_1, f_2);
+        } catch (...) {
+          job->report.note = "comparison failed";
+          report_failure(comparer_, *job);
+        }
+      });
+    }
+
+    pool.wait();
+  }
+
+  seconds = tmr.elapsed();
+
+  std::ofstream log_f(log_fn);
+  if (!log_f) {
+    std::cout << "cannot create log file" << std::endl;
+  }
+
+  AgreeLevel al = AgreeLevel::Exact_eq;
+  reports.clear();
+  for (auto const &job : jobs) {
+    log_f << "================= " << job->report.rel_path
+          << " =================" << std::endl;
+    if (!job->report.note.empty()) {
+      log_f << job->report.note << std::endl;
+      // a failed pair may not have reached its last chunk
+      job->report.level = AgreeLevel::Not_eq;
+    } else {
+      log_f << job->log;
+    }
+    log_f << std::endl;
+
+    al = std::min(al, job->report.level);
+    reports.push_back(job->report);
+  }
+
+  report(log_f, reports, seconds);
+  log_f.close();
+
+  if (reports.empty()) al = AgreeLevel::Not_eq;
+  return al;
+}
+
+void DirComparer::report(std::ostream &out,
+                         const std::vector<FileReport> &reports,
+                         double seconds) {
+  Long64_t total_bytes = 0;
+  int n_equal = 0;
+  for (auto const &r : reports) {
+    out << std::left << std::setw(12) << agree_level_name(r.level) << " "
+        << r.rel_path;
+    if (!r.note.empty()) {
+      out << " (" << r.note << ")";
+    } else {
+      out << " (" << r.bytes << " bytes in " << r.seconds << " s)";
+    }
+    out << std::endl;
+    total_bytes += r.bytes;
+    if (r.level != AgreeLevel::Not_eq) n_equal++;
+  }
+
+  out << "Number of file pairs: " << reports.size() << std::endl;
+  out << "Number of equal file pairs: " << n_equal << std::endl;
+  out << "Bytes in both directories: " << total_bytes << std::endl;
+  out << "Time elapsed: " << seconds << " s" << std::endl;
+  out << "Throughput: "
+      << (seconds > 0. ? total_bytes / seconds / (1 << 20) : 0.) << " MB/s"
+      << std::endl;
+
+  // the cache is shared by every pair, so its hits are payloads that
+  // recur across files
+  ContentCache &cache = ContentCache::instance();
+  CacheStats cache_stats = cache.stats();
+  if (cache.enabled() and cache_stats.used()) {
+    out << "Content cache: " << cache_stats.hits << " hits, "
+        << cache_stats.misses << " misses, " << cache.evictions()
+        << " evictions" << std::endl;
+  }
+}
+
+}  // namespace rootdiff
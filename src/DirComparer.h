@@ -0,0 +1,87 @@
+#ifndef ROOT_DIFF_DIR_COMPARATOR
+#define ROOT_DIFF_DIR_COMPARATOR
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "FileComparer.h"
+
+/**
+ * Files whose structurally equal objects sum to more bytes than this
+ * have their content comparison split into chunks of about this size.
+ */
+#define CHUNK_BYTES (64LL << 20)
+
+namespace rootdiff {
+
+/**
+ * Result of comparing one pair of files in a dataset
+ */
+struct FileReport {
+  /// Path of the file relative to the dataset directories
+  std::string rel_path;
+  /// Agreement level of the pair
+  AgreeLevel level;
+  /// Sum of the sizes of the two files
+  Long64_t bytes;
+  /// Wall time from the start of the scan to the last chunk compared
+  double seconds;
+  /// Why the pair could not be compared, empty if it was
+  std::string note;
+};
+
+/**
+ * Compare two dataset directories file by file
+ *
+ * Files are paired by their path relative to the two directories.
+ * Every pair is scanned and matched in its own task on a work-stealing
+ * thread pool, and its content comparison is split into chunks of
+ * object pairs so that a single large file does not hold up the run.
+ */
+class DirComparer {
+ public:
+  /**
+   * Constructor
+   *
+   * @param[in] comparer File comparator used for every pair of files
+   * @param[in] n_threads Number of worker threads
+   */
+  DirComparer(const FileComparer &comparer, unsigned int n_threads)
+      : comparer_(comparer), n_threads_(n_threads) {}
+
+  /*
+   * Compare two dataset directories and return the lowest agreement level
+   * among the pairs of files
+   *
+   * @param[in] dir_1 Path to directory 1
+   * @param[in] dir_2 Path to directory 2
+   * @param[in] mode Mode of comparison
+   * @param[in] log_fn Name of log file, collects the details of every pair
+   * @param[in] ignored_classes set of class names to ignore during comparison
+   * @param[out] reports Result of every pair, sorted by relative path
+   * @param[out] seconds Wall time of the whole comparison
+   */
+  AgreeLevel comp(const std::string &dir_1, const std::string &dir_2,
+                  const std::string &mode, const std::string &log_fn,
+                  const std::set<std::string> &ignored_classes,
+                  std::vector<FileReport> &reports, double &seconds) const;
+
+  /*
+   * Write the aggregated report of a dataset comparison
+   *
+   * One line per pair of files with its agreement level, followed by
+   * the totals and the throughput over the bytes of both directories.
+   */
+  static void report(std::ostream &out, const std::vector<FileReport> &reports,
+                     double seconds);
+
+ private:
+  const FileComparer &comparer_;
+  unsigned int n_threads_;
+};
+
+}  // namespace rootdiff
+
+#endif
@@ -1,21 +1,23 @@
-#include "root_file_comparator.h"
+#include "FileComparer.h"
 
+#include <algorithm>
+#include <cctype>
 #include <exception>
 
+#include "Progress.h"
+#include "TROOT.h"
+#include "ThreadPool.h"
+
 namespace rootdiff {
 
 /**
  * Get the next string from the input header
  */
-std::string get_next(char *header) {
-  char str_len;
-  frombuf(header, &str_len);
-  char* str = new char[str_len];
-  for (int i = 0; i < str_len; i++) {
-    frombuf(header, &str[i]);
-  }
-  std::string ret(str);
-  delete[] str;
+std::string get_next(char *&header) {
+  unsigned char str_len;
+  frombuf(header, (char *)&str_len);
+  std::string ret(header, str_len);
+  header += str_len;
   return ret;
 }
 
@@ -24,10 +26,12 @@ std::string get_next(char *header) {
  *
  * @param[in] header_array bytes in the header of the file
  * @param[in] cur current index of header
- * @param[in] f Pointer to open TFile
+ * @param[in] file_header Offsets of the special records of the file
+ * @param[in] quiet Do not report an unreadable header, it is only a guess
  */
 static ObjectInfo get_obj_info(char *header_array, Long64_t cur,
-                               const TFile &f, bool debug) {
+                               const FileHeader &file_header, bool debug,
+                               bool quiet = false) {
   UInt_t datime;
   ObjectInfo obj_info;
   char *header;
@@ -37,7 +41,9 @@ static ObjectInfo get_obj_info(char *header_array, Long64_t cur,
   header = header_array;
   frombuf(header, &(obj_info.nbytes));
   if (!obj_info.nbytes) {
-    std::cerr << "The size of the object buffer is unaccessible." << std::endl;
+    if (!quiet) {
+      std::cerr << "The size of the object buffer is unaccessible." << std::endl;
+    }
     throw std::exception();
   }
 
@@ -63,13 +69,13 @@ static ObjectInfo get_obj_info(char *header_array, Long64_t cur,
   // Get the class name of object
   obj_info.class_name = get_next(header);
 
-  if (cur == f.GetSeekFree()) {
+  if (cur == file_header.seek_free) {
     obj_info.class_name = "FreeSegments";
   }
-  if (cur == f.GetSeekInfo()) {
+  if (cur == file_header.seek_info) {
     obj_info.class_name = "StreamerInfo";
   }
-  if (cur == f.GetSeekKeys()) {
+  if (cur == file_header.seek_keys) {
     obj_info.class_name = "KeysList";
   }
 
@@ -97,15 +103,7 @@ static ObjectInfo get_obj_info(char *header_array, Long64_t cur,
   return std::move(obj_info);
 }
 
-AgreeLevel FileComparer::comp(const std::string &fn_1, 
-                              const std::string &fn_2,
-                              const std::string &mode,
-                              const std::string &log_fn,
-                              std::set<std::string> ignored_classes) const {
-  int num_obj_in_f1 = 0, num_obj_in_f2 = 0, num_logical_equal = 0,
-      num_exact_equal = 0, num_strict_equal = 0;
-
-  // Get comparison mode
+ObjectComparer FileComparer::make_obj_comparer(const std::string &mode) const {
   bool compressed{false};
   if (mode == "CC") {
     compressed = true;
@@ -113,125 +111,481 @@ AgreeLevel FileComparer::comp(const std::string &fn_1,
     std::cerr << "Unrecognized comparison mode '" << mode << "'" << std::endl;
     throw std::exception();
   }
-  ObjectComparer obj_comp(debug_, compressed);
-
-  // Check if input files are accessible
-  if (access(fn_1.c_str(), F_OK) == -1) {
-    std::cout << fn_1 << " does not exist." << std::endl;
-    throw std::exception();
-  }
+  ObjectComparer obj_comp(debug_, compressed, strategies_);
+  if (tolerant_) obj_comp.set_tolerance(abs_eps_, rel_eps_);
+  return obj_comp;
+}
 
-  if (access(fn_2.c_str(), F_OK) == -1) {
-    std::cout << fn_2 << " does not exist." << std::endl;
-    throw std::exception();
-  }
+/**
+ * Read the key header of the record at cur
+ *
+ * @param[in] quiet Do not report errors, the record is only a guess
+ * @return false if the header could not be read from disk
+ */
+static bool read_record(RootFile &f, Long64_t cur, Long64_t f_end, bool debug,
+                        ObjectInfo &obj_info, bool quiet = false) {
+  Int_t nread = KEY_HEADER_LEN;
 
-  bool logic_eq = true, strict_eq = true, exact_eq = true;
+  // zero what is not read so that a truncated header parses the same way
+  // every time
+  char header[KEY_HEADER_LEN] = {0};
 
-  // Create log file
-  std::ofstream log_f;
-  if (!log_f) {
-    std::cout << "cannot create log file" << std::endl;
+  if (cur + nread > f_end) {
+    nread = f_end - cur;
   }
-  log_f.open(log_fn);
-
-  Timer tmr;
-  double t = tmr.elapsed();
-
-  // Scan file 1 and generate object information array
-
-  TFile f_1(fn_1.c_str());
 
-  Int_t nwheader;
-  nwheader = 64;
-  Int_t nread_1 = nwheader;
-
-  Long64_t cur_1 = HEADER_LEN, f1_end = f_1.GetEND();
+  if (!f.read(header, cur, nread)) {
+    if (!quiet) {
+      std::cerr << "Failed to read the object header from "
+        << f.name() << " from disk at " << cur << std::endl;
+    }
+    return false;
+  }
 
-  char header_1[HEADER_LEN];
+  obj_info = get_obj_info(header, cur, f.header(), debug, quiet);
+  return true;
+}
 
-  ObjectInfo obj_info_1;
+/**
+ * Follow the chain of records from cur until reaching stop
+ *
+ * Each record's nbytes gives the offset of the next one, gaps left by
+ * deleted objects have a negative nbytes.
+ *
+ * @param[in] scanned Counter of the bytes walked, may be nullptr
+ * @param[in] speculative cur is only a guess: report no errors and stop
+ * at a key that does not give its own offset as seek_key
+ * @return offset after the last record walked, -1 if a header could
+ * not be read
+ */
+static Long64_t walk(RootFile &f, Long64_t cur, Long64_t stop, Long64_t f_end,
+                     bool debug, std::vector<Record> &records,
+                     std::atomic<Long64_t> *scanned,
+                     bool speculative = false) {
+  BatchedCounter counter(scanned);
+  ObjectInfo obj_info;
+  while (cur < stop) {
+    if (!read_record(f, cur, f_end, debug, obj_info, speculative)) return -1;
+    // the header of a gap is not a key, only its nbytes is meaningful
+    if (speculative and obj_info.nbytes > 0 and obj_info.seek_key != cur) {
+      return -1;
+    }
+    records.push_back({cur, obj_info});
+    Long64_t len = obj_info.nbytes < 0 ? -obj_info.nbytes : obj_info.nbytes;
+    cur += len;
+    counter.add(len);
+  }
+  return cur;
+}
 
-  std::vector<ObjectInfo> objs_info;
+/**
+ * Check whether a TKey header plausibly starts at offset
+ *
+ * The header must give a positive size within the file, a known key
+ * version, a key length within the record, its own offset as seek_key
+ * and a class name made of identifier characters that fits in the key
+ * along with the object name and title.
+ *
+ * @param[in] b Bytes at offset, at least KEY_HEADER_LEN of them
+ */
+static bool plausible_key(char *b, Long64_t offset, Long64_t f_end) {
+  Int_t nbytes, obj_len;
+  Version_t version_key;
+  UInt_t datime;
+  Short_t key_len, cycle;
+
+  frombuf(b, &nbytes);
+  frombuf(b, &version_key);
+  frombuf(b, &obj_len);
+  frombuf(b, &datime);
+  frombuf(b, &key_len);
+  frombuf(b, &cycle);
+
+  if (nbytes <= 0 or offset + nbytes > f_end) return false;
+  if (version_key % 1000 < 2 or version_key % 1000 > 4 or
+      version_key / 1000 > 1 or version_key < 0) {
+    return false;
+  }
+  if (obj_len < 0 or cycle < 0) return false;
 
-  while (cur_1 < f1_end) {
-    num_obj_in_f1++;
-    f_1.Seek(cur_1);
+  // the fixed part ends with seek_key and seek_pdir
+  int seek_len = version_key > 1000 ? sizeof(Long64_t) : sizeof(Int_t);
+  int fixed_len = 18 + 2 * seek_len;
+  if (key_len < fixed_len + 3 or key_len > nbytes) return false;
 
-    if (cur_1 + nread_1 >= f1_end) {
-      nread_1 = f1_end - cur_1 - 1;
+  Long64_t seek_key;
+  if (version_key > 1000) {
+    frombuf(b, &seek_key);
+    b += sizeof(Long64_t);
+  } else {
+    Int_t s_key;
+    frombuf(b, &s_key);
+    b += sizeof(Int_t);
+    seek_key = s_key;
+  }
+  if (seek_key != offset) return false;
+
+  // one length byte each for the class name, object name and title
+  unsigned char name_len = (unsigned char)*b++;
+  if (name_len == 0 or name_len > key_len - fixed_len - 3) return false;
+  if (!isalpha((unsigned char)b[0])) return false;
+  for (int i = 0; i < name_len; i++) {
+    char c = b[i];
+    if (!isalnum((unsigned char)c) and c != '_' and c != ':' and c != '<' and
+        c != '>' and c != ',' and c != ' ') {
+      return false;
     }
+  }
+  return true;
+}
 
-    if (f_1.ReadBuffer(header_1, nread_1)) {
-      std::cerr << "Failed to read the object header from "
-        << fn_1 << "from disk at " << cur_1 << std::endl;
-      return AgreeLevel::Not_eq;
-    }
+/**
+ * Records walked by one thread of the parallel scan
+ */
+struct ScanRange {
+  /// First byte of the range
+  Long64_t begin;
+  /// Byte after the range
+  Long64_t end;
+  /// Records from the first key of the range that starts a chain to the end
+  std::vector<Record> records;
+  /// Offset of the first record, -1 if no key of the range starts a chain
+  Long64_t sync{-1};
+  /// Offset after the last record, -1 if the walk stopped early
+  Long64_t next{-1};
+  /// Reads of the thread
+  IOStats io;
+};
 
-    obj_info_1 = get_obj_info(header_1, cur_1, f_1, debug_);
-    obj_info_1.obj_index = num_obj_in_f1;
+/**
+ * Find the first plausible key in [from, end)
+ *
+ * @param[in,out] block Buffer of SCAN_BLOCK_LEN + KEY_HEADER_LEN bytes
+ * @return offset of the key, -1 if there is none or the file could not
+ * be read
+ */
+static Long64_t find_key(RootFile &f, Long64_t from, Long64_t end,
+                         Long64_t f_end, std::vector<char> &block) {
+  for (Long64_t block_begin = from; block_begin < end;
+       block_begin += SCAN_BLOCK_LEN) {
+    // read enough past the block to check a header at its last byte
+    Long64_t nread = std::min(SCAN_BLOCK_LEN + KEY_HEADER_LEN, f_end - block_begin);
+    Long64_t nscan = std::min(SCAN_BLOCK_LEN, end - block_begin);
+    if (!f.read(block.data(), block_begin, nread)) return -1;
+    memset(block.data() + nread, 0, block.size() - nread);
+
+    for (Long64_t i = 0; i < nscan; i++) {
+      if (plausible_key(block.data() + i, block_begin + i, f_end)) {
+        return block_begin + i;
+      }
+    }
+  }
+  return -1;
+}
 
-    if (obj_info_1.nbytes < 0) {
-      cur_1 -= obj_info_1.nbytes;
-      continue;
+/**
+ * Find the first plausible key in the range and walk from it
+ *
+ * A walk that runs into a record whose key is not where the chain
+ * expects it started from a wrong guess, the range is then
+ * resynchronized at the next plausible key. The chain is validated
+ * again when the ranges are stitched together.
+ */
+static void walk_range(RootFile &f, ScanRange &range,
+                       std::atomic<Long64_t> *scanned) {
+  Long64_t f_end = f.header().end;
+  std::vector<char> block(SCAN_BLOCK_LEN + KEY_HEADER_LEN);
+
+  Long64_t from = range.begin;
+  while (from < range.end) {
+    Long64_t sync = -1, next = -1;
+    try {
+      sync = find_key(f, from, range.end, f_end, block);
+      if (sync < 0) break;
+      range.records.clear();
+      next = walk(f, sync, range.end, f_end, false, range.records, nullptr,
+                  true);
+    } catch (...) {
+      // garbage after a wrong guess
+      if (sync < 0) break;
     }
 
-    if (debug_) {
-      std::cout << "Ignored classes are: ";
-      for (auto const& c : ignored_classes) {
-        std::cout << c << " ";
+    if (next >= 0) {
+      range.sync = sync;
+      range.next = next;
+      // the last record may end in the next range, which counts its bytes
+      if (scanned) {
+        scanned->fetch_add(std::min(next, range.end) - sync,
+                           std::memory_order_relaxed);
       }
-      std::cout << std::endl;
+      return;
     }
+    from = sync + 1;
+  }
 
-    if (ignored_classes.find(obj_info_1.class_name) == ignored_classes.end()) {
-      objs_info.push_back(obj_info_1);
-    } else {
-      log_f << obj_info_1.class_name << " in file 1 with index "
-            << obj_info_1.obj_index << " and object name "
-            << obj_info_1.obj_name << " is ignored" << std::endl;
-    }
+  // no key of the range starts a chain, which the stitching walks serially
+  range.records.clear();
+  range.sync = -1;
+  range.next = -1;
+}
 
-    cur_1 += obj_info_1.nbytes;
+/**
+ * Number of bytes of [from, to) that no thread counted as scanned
+ *
+ * The thread of a range counts the bytes from its first record up to the
+ * end of the range or of its last record, whichever comes first.
+ */
+static Long64_t uncounted(const std::vector<ScanRange> &ranges, Long64_t from,
+                          Long64_t to) {
+  Long64_t n = to - from;
+  for (auto const &range : ranges) {
+    if (range.sync < 0) continue;
+    Long64_t lo = std::max(from, range.sync);
+    Long64_t hi = std::min({to, range.next, range.end});
+    if (hi > lo) n -= hi - lo;
   }
+  return n;
+}
 
-  // For each object in file 2, find if there exists an object which
-  // has same information in file 1. construct an table whose entry is
-  // the pair of objects share same information from file 1 and file 2.
-  // If there exists an object in file 2 which does not has matched
-  // object in file 1, we say file 1 is not equal to file 2
+/**
+ * Walk the records of a large file with several threads
+ *
+ * The file is split into byte ranges and each thread resynchronizes to
+ * the first plausible key in its range. The ranges are then stitched in
+ * order: records of a range are only used from the first one the chain
+ * of the previous ranges actually lands on, and the chain is walked
+ * serially wherever it does not land on a record found by a thread.
+ */
+static bool walk_parallel(const IOConfig &io_config, RootFile &f,
+                          Long64_t f_end, unsigned int n_ranges, bool debug,
+                          std::vector<Record> &records,
+                          std::atomic<Long64_t> *scanned) {
+  std::vector<ScanRange> ranges(n_ranges);
+  Long64_t range_len = (f_end - HEADER_LEN) / n_ranges;
+  for (unsigned int i = 0; i < n_ranges; i++) {
+    ranges[i].begin = HEADER_LEN + i * range_len;
+    ranges[i].end = (i + 1 == n_ranges) ? f_end : ranges[i].begin + range_len;
+  }
 
-  TFile f_2(fn_2.c_str());
+  ROOT::EnableThreadSafety();
+  {
+    ThreadPool pool(n_ranges);
+    for (auto &range : ranges) {
+      pool.submit([&io_config, &f, &range, scanned] {
+        try {
+          // every thread reads the file with its own backend
+          RootFile f_range(f.name(), open_backend(io_config, f.name()));
+          walk_range(f_range, range, scanned);
+          range.io = f_range.io().stats();
+        } catch (...) {
+          range.next = -1;
+        }
+      });
+    }
+    pool.wait();
+  }
+  for (auto const &range : ranges) f.io().add_stats(range.io);
+
+  Long64_t cur = HEADER_LEN;
+  int n_adopted = 0;
+  Long64_t n_serial = 0;
+  BatchedCounter counter(scanned);
+  for (auto &range : ranges) {
+    auto const &recs = range.records;
+    std::size_t first = recs.size();
+    while (cur < range.end) {
+      auto it = std::lower_bound(
+          recs.begin(), recs.end(), cur,
+          [](const Record &rec, Long64_t off) { return rec.offset < off; });
+      if (first == recs.size() and it != recs.end() and it->offset == cur) {
+        // The chain landed on the records of this range, take them
+        first = it - recs.begin();
+        records.insert(records.end(), it, recs.end());
+        n_adopted++;
+        if (range.next >= 0) {
+          // the thread counted its last record up to the end of the range
+          if (range.next > range.end) {
+            counter.add(uncounted(ranges, range.end, range.next));
+          }
+          cur = range.next;
+        } else {
+          const ObjectInfo &last = recs.back().info;
+          cur = recs.back().offset +
+                (last.nbytes < 0 ? -last.nbytes : last.nbytes);
+        }
+        continue;
+      }
 
-  Int_t nread_2 = nwheader;
+      // Step serially until the chain meets the records of the range
+      ObjectInfo obj_info;
+      if (!read_record(f, cur, f_end, debug, obj_info)) return false;
+      records.push_back({cur, obj_info});
+      Long64_t len = obj_info.nbytes < 0 ? -obj_info.nbytes : obj_info.nbytes;
+      counter.add(uncounted(ranges, cur, cur + len));
+      cur += len;
+      n_serial++;
+    }
+  }
 
-  Long64_t cur_2 = HEADER_LEN, f2_end = f_2.GetEND();
+  if (debug) {
+    std::cout << "Parallel scan of " << f.name() << ": " << n_adopted << " of "
+              << n_ranges << " ranges joined the chain, " << n_serial
+              << " records walked serially" << std::endl;
+  }
 
-  char header_2[HEADER_LEN];
+  return true;
+}
 
-  ObjectInfo obj_info_2;
+bool FileComparer::scan(RootFile &f, int file_num,
+                        const std::set<std::string> &ignored_classes,
+                        std::ostream &log_f,
+                        std::vector<ObjectInfo> &objs_info,
+                        int &num_obj) const {
+  Long64_t f_end = f.header().end;
+
+  ProgressFile *pf = progress_ ? progress_->add_file(f.name(), f_end) : nullptr;
+  std::atomic<Long64_t> *scanned = pf ? &pf->scanned : nullptr;
+
+  std::vector<Record> records;
+  unsigned int n_ranges = std::min<Long64_t>(scan_threads_, f_end / PARALLEL_SCAN_BYTES);
+  bool ok;
+  if (n_ranges > 1) {
+    ok = walk_parallel(io_config_, f, f_end, n_ranges, debug_, records,
+                       scanned);
+  } else {
+    ok = walk(f, HEADER_LEN, f_end, f_end, debug_, records, scanned) >= 0;
+  }
+  if (pf) {
+    if (ok) pf->scanned = f_end;
+    progress_->finish_file(pf);
+  }
+  if (!ok) return false;
 
-  std::vector<std::pair<ObjectInfo , ObjectInfo >> objs_pair;
+  collect(records, file_num, ignored_classes, log_f, objs_info, num_obj);
+  return true;
+}
 
-  while (cur_2 < f2_end) {
-    num_obj_in_f2++;
-    f_2.Seek(cur_2);
+bool FileComparer::scan_tail(RootFile &f, int file_num,
+                             const std::set<std::string> &ignored_classes,
+                             std::ostream &log_f, Long64_t &cur, Long64_t size,
+                             std::vector<ObjectInfo> &objs_info,
+                             int &num_obj) const {
+  std::vector<Record> records;
+  ObjectInfo obj_info;
 
-    if (cur_2 + nread_2 >= f2_end) {
-      nread_2 = f2_end - cur_2 - 1;
+  // The last record may still be incomplete, stop at the first record
+  // whose header or payload is not entirely on disk yet
+  while (cur < size) {
+    try {
+      if (!read_record(f, cur, size, debug_, obj_info)) return false;
+    } catch (...) {
+      break;
     }
+    Long64_t len = obj_info.nbytes < 0 ? -obj_info.nbytes : obj_info.nbytes;
+    if (cur + len > size) break;
+    records.push_back({cur, obj_info});
+    cur += len;
+  }
 
-    if (f_2.ReadBuffer(header_2, nread_2)) {
-      std::cerr << "Failed to read the object header from "
-       << fn_2 << " from disk at " << cur_2 << std::endl;
-      return AgreeLevel::Not_eq;
+  collect(records, file_num, ignored_classes, log_f, objs_info, num_obj);
+  return true;
+}
+
+bool FileComparer::stream(
+    RootFile &f,
+    const std::function<void(const ObjectInfo &, char *)> &visit) const {
+  Long64_t f_end = f.header().end;
+
+  ProgressFile *pf = progress_ ? progress_->add_file(f.name(), f_end) : nullptr;
+  bool ok = true;
+  {
+    BatchedCounter counter(pf ? &pf->scanned : nullptr);
+
+    // bytes of the file from block_begin on
+    std::vector<char> block;
+    Long64_t block_begin = HEADER_LEN;
+
+    // Bytes [from, from + len) of the file, the block is refilled from
+    // from on if it does not hold them, keeping the bytes it already has
+    auto fetch = [&](Long64_t from, Long64_t len) -> char * {
+      Long64_t held = block_begin + (Long64_t)block.size() - from;
+      if (held >= len) return block.data() + (from - block_begin);
+      if (held < 0) held = 0;
+
+      std::vector<char> next(std::min(std::max<Long64_t>(len, SCAN_BLOCK_LEN), f_end - from));
+      std::memcpy(next.data(), block.data() + (block.size() - held), held);
+      if (!f.read(next.data() + held, from + held, next.size() - held)) {
+        std::cerr << "Failed to read the records of " << f.name()
+                  << " from disk at " << from + held << std::endl;
+        return nullptr;
+      }
+      block.swap(next);
+      block_begin = from;
+      return block.data();
+    };
+
+    ObjectInfo obj_info;
+    int num_obj = 0;
+    Long64_t cur = HEADER_LEN;
+    while (cur < f_end) {
+      // zero what is past the end of the file as read_record does
+      char header[KEY_HEADER_LEN] = {0};
+      Long64_t header_len = std::min<Long64_t>(KEY_HEADER_LEN, f_end - cur);
+      char *bytes = fetch(cur, header_len);
+      if (!bytes) {
+        ok = false;
+        break;
+      }
+      std::memcpy(header, bytes, header_len);
+      try {
+        obj_info = get_obj_info(header, cur, f.header(), debug_);
+      } catch (...) {
+        ok = false;
+        break;
+      }
+      obj_info.obj_index = ++num_obj;
+      obj_info.class_id = strategies_->class_id(obj_info.class_name);
+
+      Long64_t len = obj_info.nbytes < 0 ? -obj_info.nbytes : obj_info.nbytes;
+      if (obj_info.nbytes > 0) {
+        if (cur + len > f_end or obj_info.key_len > len) {
+          std::cerr << "The record at " << cur << " of " << f.name()
+                    << " does not fit in the file" << std::endl;
+          ok = false;
+          break;
+        }
+        bytes = fetch(cur, len);
+        if (!bytes) {
+          ok = false;
+          break;
+        }
+        visit(obj_info, bytes + obj_info.key_len);
+      }
+      cur += len;
+      counter.add(len);
     }
+  }
 
-    obj_info_2 = get_obj_info(header_2, cur_2, f_2, debug_);
-    obj_info_2.obj_index = num_obj_in_f2;
+  if (pf) {
+    if (ok) pf->scanned = f_end;
+    progress_->finish_file(pf);
+  }
+  return ok;
+}
+
+void FileComparer::collect(std::vector<Record> &records, int file_num,
+                           const std::set<std::string> &ignored_classes,
+                           std::ostream &log_f,
+                           std::vector<ObjectInfo> &objs_info,
+                           int &num_obj) const {
+  for (auto &rec : records) {
+    num_obj++;
 
-    if (obj_info_2.nbytes < 0) {
-      cur_2 -= obj_info_2.nbytes;
+    ObjectInfo &obj_info = rec.info;
+    obj_info.obj_index = num_obj;
+    obj_info.class_id = strategies_->class_id(obj_info.class_name);
+
+    if (obj_info.nbytes < 0) {
       continue;
     }
 
@@ -243,46 +597,82 @@ AgreeLevel FileComparer::comp(const std::string &fn_1,
       std::cout << std::endl;
     }
 
-    if (ignored_classes.find(obj_info_2.class_name) == ignored_classes.end()) {
-      // If current class is not in the ignored classes list
-      bool found_match{false};
-      for (auto info_it = objs_info.begin(); info_it != objs_info.end(); ++info_it) {
-        ObjectInfo& info = *info_it;
-        if (obj_comp.logic_cmp(info, obj_info_2)) {
-          num_logical_equal++;
-          std::pair<ObjectInfo , ObjectInfo> obj_pair(info, obj_info_2);
-          // every obj_info can only be used once
-          log_f << info.class_name << " with index "
-                << info.obj_index << " with object name "
-                << info.obj_name << " in file 1 is structual-equal to "
-                << obj_info_2.class_name << " with index "
-                << obj_info_2.obj_index << " and object name "
-                << obj_info_2.obj_name << " in file 2 " << std::endl;
-
-          objs_info.erase(info_it);
-          objs_pair.push_back(obj_pair);
-          found_match = true;
-          break;
-        } //found logical match
-      } //loop over object info
-
-      if (not found_match) {
-        // does not found matched object in file 1
-        log_f << "Cannot find matched object for the instance of "
-              << obj_info_2.class_name << " in file 2 with index "
-              << obj_info_2.obj_index << std::endl;
-
-        logic_eq = false;
-        strict_eq = false;
-        exact_eq = false;
-      }
+    if (ignored_classes.find(obj_info.class_name) == ignored_classes.end()) {
+      objs_info.push_back(obj_info);
     } else {
-      log_f << obj_info_2.class_name << " in file 2 with index "
-            << obj_info_2.obj_index << " and object name "
-            << obj_info_2.obj_name << " is ignored" << std::endl;
+      log_f << obj_info.class_name << " in file " << file_num
+            << " with index " << obj_info.obj_index << " and object name "
+            << obj_info.obj_name << " is ignored" << std::endl;
     }
+  }
+
+}
+
+bool FileComparer::match(RootFile &f_1, RootFile &f_2,
+                         const std::set<std::string> &ignored_classes,
+                         std::ostream &log_f,
+                         std::vector<ObjectPair> &objs_pair,
+                         CompareStats &stats,
+                         const CountedPairs *counted) const {
+  // Scan file 1 and generate object information array
+  std::vector<ObjectInfo> objs_info;
+  if (!scan(f_1, 1, ignored_classes, log_f, objs_info,
+            stats.num_obj_in_f1)) {
+    return false;
+  }
 
-    cur_2 += obj_info_2.nbytes;
+  std::vector<ObjectInfo> objs_info_2;
+  if (!scan(f_2, 2, ignored_classes, log_f, objs_info_2,
+            stats.num_obj_in_f2)) {
+    return false;
+  }
+
+  // For each object in file 2, find if there exists an object which
+  // has same information in file 1. construct an table whose entry is
+  // the pair of objects share same information from file 1 and file 2.
+  // If there exists an object in file 2 which does not has matched
+  // object in file 1, we say file 1 is not equal to file 2
+
+  ObjectComparer obj_comp = make_obj_comparer("CC");
+  std::size_t n_pairs = objs_pair.size();
+
+  for (auto const& obj_info_2 : objs_info_2) {
+    bool found_match{false};
+    for (auto info_it = objs_info.begin(); info_it != objs_info.end(); ++info_it) {
+      ObjectInfo& info = *info_it;
+      if (obj_comp.logic_cmp(info, obj_info_2)) {
+        stats.num_logical_equal++;
+        // every obj_info can only be used once
+        log_f << info.class_name << " with index "
+              << info.obj_index << " with object name "
+              << info.obj_name << " in file 1 is structual-equal to "
+              << obj_info_2.class_name << " with index "
+              << obj_info_2.obj_index << " and object name "
+              << obj_info_2.obj_name << " in file 2 " << std::endl;
+
+        objs_pair.emplace_back(info, obj_info_2);
+        objs_info.erase(info_it);
+        found_match = true;
+        break;
+      } //found logical match
+    } //loop over object info
+
+    if (not found_match) {
+      // does not found matched object in file 1
+      log_f << "Cannot find matched object for the instance of "
+            << obj_info_2.class_name << " in file 2 with index "
+            << obj_info_2.obj_index << std::endl;
+
+      stats.logic_eq = false;
+      stats.tolerant_eq = false;
+      stats.strict_eq = false;
+      stats.exact_eq = false;
+      if (progress_ and !progress_->has_difference()) {
+        progress_->difference(obj_info_2.class_name + " with object name " +
+                              obj_info_2.obj_name + " in " + f_2.name() +
+                              " has no match in " + f_1.name());
+      }
+    }
   }
 
   // After iterating all objects in file 2, if there are obj_info left in file
@@ -296,18 +686,58 @@ AgreeLevel FileComparer::comp(const std::string &fn_1,
             << ", cycle number " << info.cycle << " and object name "
             << info.obj_name << std::endl;
     }
-    logic_eq = false;
-    strict_eq = false;
-    exact_eq = false;
+    stats.logic_eq = false;
+    stats.tolerant_eq = false;
+    stats.strict_eq = false;
+    stats.exact_eq = false;
+    if (progress_ and !progress_->has_difference()) {
+      auto const &info = objs_info.front();
+      progress_->difference(info.class_name + " with object name " +
+                            info.obj_name + " in " + f_1.name() +
+                            " has no match in " + f_2.name());
+    }
   }
 
+  if (progress_) {
+    Long64_t n_new = 0;
+    for (std::size_t i = n_pairs; i < objs_pair.size(); i++) {
+      auto const &[first, second] = objs_pair[i];
+      if (!counted or !counted->count({first.seek_key, second.seek_key})) {
+        n_new++;
+      }
+    }
+    progress_->add_pairs(n_new);
+    progress_->lower_level(stats.level());
+  }
+
+  return true;
+}
+
+void FileComparer::compare_pairs(const ObjectComparer &obj_comp,
+                                 RootFile &f_1, RootFile &f_2,
+                                 std::vector<ObjectPair>::const_iterator begin,
+                                 std::vector<ObjectPair>::const_iterator end,
+                                 std::ostream &log_f,
+                                 CompareStats &stats,
+                                 const EqualPairs *equal_pairs,
+                                 const CountedPairs *counted) const {
   // Compare the two objects in same entry. If the two objects are
   // strictly/exactly equal to each other, we say the entry is
   // strictly/exactly agreed. If every entry is strictly/exactly agreed,
   // we say that file 1 is strictly/exactly equal to file 2.
 
-  for (auto const [first, second] : objs_pair) {
-    if (!obj_comp.strict_cmp(first, f_1, second, f_2)) {
+  CacheStats cache_before = ContentCache::thread_stats();
+  BatchedCounter compared(progress_ ? progress_->pairs_compared() : nullptr);
+
+  for (auto it = begin; it != end; ++it) {
+    auto const& [first, second] = *it;
+    if (!counted or !counted->count({first.seek_key, second.seek_key})) {
+      compared.add(1);
+    }
+    bool known_equal =
+        equal_pairs and
+        equal_pairs->count({RecordKey(first), RecordKey(second)});
+    if (!known_equal and !obj_comp.strict_cmp(first, f_1, second, f_2)) {
       log_f << first.class_name << " in file 1 with index "
             << first.obj_index << " and object name "
             << first.obj_name << " is NOT CONTENT-EQUAL to "
@@ -315,11 +745,37 @@ AgreeLevel FileComparer::comp(const std::string &fn_1,
             << second.obj_index << " and object name "
             << second.obj_name << std::endl;
 
-      strict_eq = false;
-      exact_eq = false;
+      stats.strict_eq = false;
+      stats.exact_eq = false;
+
+      // Floating-point baskets may still agree within the tolerance
+      std::string branch;
+      Deviation dev;
+      if (obj_comp.tolerant() and first.class_name == "TBasket" and
+          obj_comp.tolerance_cmp(first, f_1, second, f_2, branch, dev)) {
+        stats.num_tolerant_equal++;
+        log_f << "    but its values of " << branch
+              << " agree within the tolerance" << std::endl;
+      } else {
+        stats.tolerant_eq = false;
+      }
+      if (!branch.empty()) stats.deviations[branch].merge(dev);
+
+      if (progress_) {
+        progress_->lower_level(stats.level());
+        if (!progress_->has_difference()) {
+          progress_->difference(first.class_name + " with object name " +
+                                first.obj_name + " at " +
+                                std::to_string(first.seek_key) + " in " +
+                                f_1.name() + " is NOT CONTENT-EQUAL to " +
+                                "its match at " +
+                                std::to_string(second.seek_key) + " in " +
+                                f_2.name());
+        }
+      }
 
     } else {
-      num_strict_equal++;
+      stats.num_strict_equal++;
       if (!obj_comp.exact_cmp(first, second)) {
         log_f << first.class_name << " in file 1 with index "
               << first.obj_index << " and object name "
@@ -328,36 +784,108 @@ AgreeLevel FileComparer::comp(const std::string &fn_1,
               << second.obj_index << " and object name "
               << second.obj_name << std::endl;
 
-        exact_eq = false;
+        stats.exact_eq = false;
+        if (progress_) progress_->lower_level(stats.level());
       } else {
-        num_exact_equal++;
+        stats.num_exact_equal++;
       }
     }
   }
 
-  tmr.reset();
-  t = tmr.elapsed();
+  CacheStats cache_after = ContentCache::thread_stats();
+  stats.cache.hits += cache_after.hits - cache_before.hits;
+  stats.cache.misses += cache_after.misses - cache_before.misses;
+}
+
+void FileComparer::summarize(std::ostream &log_f, const CompareStats &stats,
+                             double t) const {
   log_f << std::endl;
   log_f << "================= Comparison summary =================" << std::endl;
   log_f << "Time elapsed: " << t << std::endl;
 
-  log_f << "Number of objects in file 1 is: " << num_obj_in_f1 << std::endl;
-  log_f << "Number of objects in file 2 is: " << num_obj_in_f2 << std::endl;
-  log_f << "Number of structural equivalent: " << num_logical_equal << std::endl;
-  log_f << "Number of content equivalent: " << num_strict_equal << std::endl;
-  log_f << "Number of bitwise equivalent: " << num_exact_equal << std::endl;
+  log_f << "Number of objects in file 1 is: " << stats.num_obj_in_f1 << std::endl;
+  log_f << "Number of objects in file 2 is: " << stats.num_obj_in_f2 << std::endl;
+  log_f << "Number of structural equivalent: " << stats.num_logical_equal << std::endl;
+  log_f << "Number of content equivalent: " << stats.num_strict_equal << std::endl;
+  log_f << "Number of bitwise equivalent: " << stats.num_exact_equal << std::endl;
+
+  log_f << "I/O backend: " << io_backend_name(io_config_.type);
+  if (io_config_.simulated()) {
+    log_f << " with " << io_config_.latency_ms << " ms latency per read";
+    if (io_config_.bandwidth_mbps > 0.) {
+      log_f << " and " << io_config_.bandwidth_mbps << " MB/s bandwidth";
+    }
+  }
+  log_f << std::endl;
+  for (int i = 1; i <= 2; i++) {
+    const IOStats &io = (i == 1 ? stats.io_1 : stats.io_2);
+    log_f << "Reads of file " << i << ": " << io.n_reads << " requests, "
+          << io.n_bytes << " bytes, " << io.seconds << " s" << std::endl;
+  }
+  if (ContentCache::instance().enabled() and stats.cache.used()) {
+    log_f << "Content cache: " << stats.cache.hits << " hits, "
+          << stats.cache.misses << " misses" << std::endl;
+  }
 
-  log_f.close();
+  if (tolerant_) {
+    log_f << "Number of equivalent within tolerance: "
+          << stats.num_tolerant_equal << std::endl;
+    for (auto const &[branch, dev] : stats.deviations) {
+      log_f << "Branch " << branch << ": max absolute deviation "
+            << dev.max_abs << ", max relative deviation " << dev.max_rel
+            << ", " << dev.n_outside << " of " << dev.n_values
+            << " values outside of tolerance" << std::endl;
+    }
+  }
+}
 
-  if (exact_eq) {
-    return AgreeLevel::Exact_eq;
-  } else if (strict_eq) {
-    return AgreeLevel::Strict_eq;
-  } else if (logic_eq) {
-    return AgreeLevel::Logic_eq;
-  } else {
+AgreeLevel FileComparer::comp(const std::string &fn_1, 
+                              const std::string &fn_2,
+                              const std::string &mode,
+                              const std::string &log_fn,
+                              std::set<std::string> ignored_classes) const {
+  // Get comparison mode
+  ObjectComparer obj_comp = make_obj_comparer(mode);
+
+  // Check if input files are accessible
+  if (access(fn_1.c_str(), F_OK) == -1) {
+    std::cout << fn_1 << " does not exist." << std::endl;
+    throw std::exception();
+  }
+
+  if (access(fn_2.c_str(), F_OK) == -1) {
+    std::cout << fn_2 << " does not exist." << std::endl;
+    throw std::exception();
+  }
+
+  // Create log file
+  std::ofstream log_f;
+  if (!log_f) {
+    std::cout << "cannot create log file" << std::endl;
+  }
+  log_f.open(log_fn);
+
+  Timer tmr;
+
+  RootFile f_1 = open(fn_1);
+  RootFile f_2 = open(fn_2);
+
+  CompareStats stats;
+  std::vector<ObjectPair> objs_pair;
+  if (!match(f_1, f_2, ignored_classes, log_f, objs_pair, stats)) {
     return AgreeLevel::Not_eq;
   }
+
+  compare_pairs(obj_comp, f_1, f_2, objs_pair.begin(), objs_pair.end(), log_f,
+                stats);
+  stats.io_1.merge(f_1.io().stats());
+  stats.io_2.merge(f_2.io().stats());
+
+  summarize(log_f, stats, tmr.elapsed());
+
+  log_f.close();
+
+  return stats.level();
 }
 
 }  // namespace rootdiff
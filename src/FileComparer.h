@@ -4,13 +4,22 @@
 #include <cstring>
 #include <ctime>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
 #include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "Bytes.h"
+#include "ContentCache.h"
+#include "RootFile.h"
 #include "RtypesCore.h"
 #include "TDatime.h"
-#include "root_obj_comparator.h"
-#include "timer.h"
+#include "ObjectComparer.h"
+#include "Timer.h"
 #include "unistd.h"
 
 /**
@@ -18,16 +27,153 @@
  */
 #define HEADER_LEN 100
 
+/**
+ * Bytes read for every key header, enough for the fixed part of a large
+ * file key followed by the class name and object name of at most 255
+ * characters each.
+ */
+#define KEY_HEADER_LEN 560
+
+/**
+ * Files of at least twice this size have their records walked by
+ * several threads, each taking a range of at least this size.
+ */
+#define PARALLEL_SCAN_BYTES (64LL << 20)
+
+/**
+ * Bytes searched at once for a key header by a thread of the parallel scan
+ */
+#define SCAN_BLOCK_LEN (1LL << 20)
+
 namespace rootdiff {
 
+class Progress;
+
 /**
- * Four agreement levels:
+ * Five agreement levels:
  * 1. NOT EQUAL - None of the below
  * 2. LOGICALLY EQUAL - Key, Cycle, and Name are Equal
- * 3. STRICTLY EQUAL - LOGICALLY and Byte-Level Content Equal
- * 4. EXACTLLY EQUAL - STRICTLY and Timestamps equal
+ * 3. TOLERANTLY EQUAL - LOGICALLY and Byte-Level Content Equal except for
+ *    float/double baskets whose values agree within the tolerance
+ * 4. STRICTLY EQUAL - LOGICALLY and Byte-Level Content Equal
+ * 5. EXACTLLY EQUAL - STRICTLY and Timestamps equal
+ */
+typedef enum AgreeLevel_enum { Not_eq, Logic_eq, Tolerant_eq, Strict_eq, Exact_eq } AgreeLevel;
+
+/**
+ * Name of an agreement level as printed in reports
+ */
+inline const char *agree_level_name(AgreeLevel al) {
+  switch (al) {
+    case AgreeLevel::Logic_eq: return "LOGICAL";
+    case AgreeLevel::Tolerant_eq: return "TOLERANT";
+    case AgreeLevel::Strict_eq: return "STRICT";
+    case AgreeLevel::Exact_eq: return "EXACT";
+    default: return "NOT EQUAL";
+  }
+}
+
+/**
+ * Pair of objects from file 1 and file 2 that are structurally equal
+ */
+typedef std::pair<ObjectInfo, ObjectInfo> ObjectPair;
+
+/**
+ * A record found while walking the keys of a file
+ */
+struct Record {
+  /// Offset of the record in the file
+  Long64_t offset;
+  /// Information in the key header, a gap if nbytes is negative
+  ObjectInfo info;
+};
+
+/**
+ * What the key header says about a record, to tell it apart from a later
+ * record written at the same offset into a reused free segment
+ */
+struct RecordKey {
+  Long64_t seek_key;
+  Int_t nbytes;
+  Int_t obj_len;
+  Int_t date;
+  Int_t time;
+  Short_t cycle;
+
+  RecordKey(const ObjectInfo &info)
+      : seek_key(info.seek_key), nbytes(info.nbytes), obj_len(info.obj_len),
+        date(info.date), time(info.time), cycle(info.cycle) {}
+
+  bool operator<(const RecordKey &other) const {
+    return std::tie(seek_key, nbytes, obj_len, date, time, cycle) <
+           std::tie(other.seek_key, other.nbytes, other.obj_len, other.date,
+                    other.time, other.cycle);
+  }
+};
+
+/**
+ * Pairs of records of file 1 and file 2 known to be content-equal
+ */
+typedef std::set<std::pair<RecordKey, RecordKey>> EqualPairs;
+
+/**
+ * Offsets (seek_key) in file 1 and file 2 of pairs of records already
+ * counted in the progress report
+ */
+typedef std::set<std::pair<Long64_t, Long64_t>> CountedPairs;
+
+/**
+ * Tallies gathered while comparing two root files
  */
-typedef enum AgreeLevel_enum { Not_eq, Logic_eq, Strict_eq, Exact_eq } AgreeLevel;
+struct CompareStats {
+  int num_obj_in_f1{0};
+  int num_obj_in_f2{0};
+  int num_logical_equal{0};
+  int num_tolerant_equal{0};
+  int num_strict_equal{0};
+  int num_exact_equal{0};
+  bool logic_eq{true};
+  bool tolerant_eq{true};
+  bool strict_eq{true};
+  bool exact_eq{true};
+  /// Deviations of the float/double branches compared within a tolerance
+  std::map<std::string, Deviation> deviations;
+  /// Reads of file 1 and file 2
+  IOStats io_1;
+  IOStats io_2;
+  /// Lookups of the content cache
+  CacheStats cache;
+
+  /**
+   * Add the content tallies and reads from comparing a subset of the
+   * object pairs
+   */
+  void merge_content(const CompareStats &other) {
+    num_tolerant_equal += other.num_tolerant_equal;
+    num_strict_equal += other.num_strict_equal;
+    num_exact_equal += other.num_exact_equal;
+    tolerant_eq = tolerant_eq and other.tolerant_eq;
+    strict_eq = strict_eq and other.strict_eq;
+    exact_eq = exact_eq and other.exact_eq;
+    for (auto const &[branch, dev] : other.deviations) {
+      deviations[branch].merge(dev);
+    }
+    io_1.merge(other.io_1);
+    io_2.merge(other.io_2);
+    cache.merge(other.cache);
+  }
+
+  /**
+   * Agreement level implied by the tallies
+   */
+  AgreeLevel level() const {
+    if (exact_eq) return AgreeLevel::Exact_eq;
+    if (strict_eq) return AgreeLevel::Strict_eq;
+    if (tolerant_eq) return AgreeLevel::Tolerant_eq;
+    if (logic_eq) return AgreeLevel::Logic_eq;
+    return AgreeLevel::Not_eq;
+  }
+};
 
 /**
  * The root file comparator class
@@ -38,7 +184,61 @@ class FileComparer {
    * Constructor
    * Set whether or not to print debug statements.
    */
-  FileComparer(bool debug) : debug_(debug) {}
+  FileComparer(bool debug)
+      : debug_(debug), strategies_(std::make_shared<StrategyTable>()) {}
+
+  /**
+   * Comparison strategy of every class
+   *
+   * Must be filled before the first comparison.
+   */
+  StrategyTable &strategies() { return *strategies_; }
+
+  /**
+   * Walk the records of large files with up to n_threads threads
+   */
+  void set_scan_threads(unsigned int n_threads) { scan_threads_ = n_threads; }
+
+  /**
+   * Read every file with the backend of the input configuration
+   */
+  void set_io(const IOConfig &io_config) { io_config_ = io_config; }
+
+  /**
+   * Open a root file with the configured backend
+   *
+   * Throws if the file cannot be opened or is not a root file.
+   *
+   * @param[in] growing Is the file still being written? It is then read
+   * with pread instead of through ROOT, which may not recover a file that
+   * has not been closed.
+   */
+  RootFile open(const std::string &fn, bool growing = false) const {
+    IOConfig io_config = io_config_;
+    if (growing and io_config.type == IOBackendType::TFile) {
+      io_config.type = IOBackendType::Pread;
+    }
+    return RootFile(fn, open_backend(io_config, fn), growing);
+  }
+
+  /**
+   * Report the progress of the scans and comparisons to the input
+   * reporter, nullptr to stop reporting
+   */
+  void set_progress(Progress *progress) { progress_ = progress; }
+
+  /// progress reporter, nullptr if progress is not reported
+  Progress *progress() const { return progress_; }
+
+  /**
+   * Compare the float/double baskets that are not content-equal within
+   * the input absolute and relative tolerances
+   */
+  void set_tolerance(double abs_eps, double rel_eps) {
+    tolerant_ = true;
+    abs_eps_ = abs_eps;
+    rel_eps_ = rel_eps;
+  }
 
   /*
    * Compare two root files and return the agreement level of the
@@ -55,9 +255,119 @@ class FileComparer {
                   const std::string &log_fn,
                   std::set<std::string> ignored_classes) const;
 
+  /*
+   * Build the object comparator for the input comparison mode
+   *
+   * Throws if the mode is not one of CC or UC.
+   */
+  ObjectComparer make_obj_comparer(const std::string &mode) const;
+
+  /*
+   * Scan the records of an open root file
+   *
+   * Objects whose class is ignored are logged and left out of objs_info.
+   *
+   * @param[in] f Open root file
+   * @param[in] file_num Number of the file in log messages (1 or 2)
+   * @param[in] ignored_classes set of class names to ignore
+   * @param[in] log_f Stream to write details to
+   * @param[out] objs_info Information of every object that is not ignored
+   * @param[out] num_obj Number of records in the file
+   * @return false if a record header could not be read
+   */
+  bool scan(RootFile &f, int file_num,
+            const std::set<std::string> &ignored_classes, std::ostream &log_f,
+            std::vector<ObjectInfo> &objs_info, int &num_obj) const;
+
+  /*
+   * Scan the complete records appended to a file that is still being
+   * written
+   *
+   * Stops at the first record that is not entirely on disk yet.
+   *
+   * @param[in,out] cur Offset of the first record not scanned yet
+   * @param[in] size Current size of the file
+   * @param[out] objs_info Information of the new objects that are not ignored
+   * @param[in,out] num_obj Number of records scanned so far
+   * @return false if a record header could not be read
+   */
+  bool scan_tail(RootFile &f, int file_num,
+                 const std::set<std::string> &ignored_classes,
+                 std::ostream &log_f, Long64_t &cur, Long64_t size,
+                 std::vector<ObjectInfo> &objs_info, int &num_obj) const;
+
+  /*
+   * Read every record of an open root file whole, in file order
+   *
+   * The file is read sequentially, SCAN_BLOCK_LEN bytes at a time or a
+   * whole record if it is larger, so that each byte is read once.
+   *
+   * @param[in] visit Called with every record but the gaps and with its
+   * payload, the bytes that follow the key, which are only valid during
+   * the call
+   * @return false if a record could not be read
+   */
+  bool stream(RootFile &f,
+              const std::function<void(const ObjectInfo &, char *)> &visit) const;
+
+  /*
+   * Scan both files and pair up the objects that are structurally equal
+   *
+   * @param[out] objs_pair Pairs of structurally equal objects
+   * @param[out] stats Object counts and the structural agreement
+   * @param[in] counted Pairs already counted in the progress report, which
+   * are not counted again
+   * @return false if either file could not be scanned
+   */
+  bool match(RootFile &f_1, RootFile &f_2,
+             const std::set<std::string> &ignored_classes, std::ostream &log_f,
+             std::vector<ObjectPair> &objs_pair, CompareStats &stats,
+             const CountedPairs *counted = nullptr) const;
+
+  /*
+   * Compare the content of a range of structurally equal object pairs
+   *
+   * @param[out] stats Content and timestamp tallies of the range
+   * @param[in] equal_pairs Keys in file 1 and file 2 of pairs already
+   * known to be content-equal, which are not read again
+   * @param[in] counted Pairs already counted in the progress report, which
+   * are not counted again
+   */
+  void compare_pairs(const ObjectComparer &obj_comp, RootFile &f_1, RootFile &f_2,
+                     std::vector<ObjectPair>::const_iterator begin,
+                     std::vector<ObjectPair>::const_iterator end,
+                     std::ostream &log_f, CompareStats &stats,
+                     const EqualPairs *equal_pairs = nullptr,
+                     const CountedPairs *counted = nullptr) const;
+
+  /*
+   * Write the comparison summary to the log
+   */
+  void summarize(std::ostream &log_f, const CompareStats &stats,
+                 double t) const;
+
+ private:
+  /// number the walked records and keep the objects that are not ignored
+  void collect(std::vector<Record> &records, int file_num,
+               const std::set<std::string> &ignored_classes,
+               std::ostream &log_f, std::vector<ObjectInfo> &objs_info,
+               int &num_obj) const;
+
  private:
   ///should we print debug messages?
   bool debug_;
+  ///compare float/double baskets within a tolerance?
+  bool tolerant_{false};
+  double abs_eps_{0.};
+  double rel_eps_{0.};
+  ///comparison strategy of every class
+  std::shared_ptr<StrategyTable> strategies_;
+  ///number of threads walking the records of a large file
+  unsigned int scan_threads_{1};
+  ///backend every file is read with
+  IOConfig io_config_;
+  ///reporter of the progress, if any
+  Progress *progress_{nullptr};
 };
 
 }  // namespace rootdiff
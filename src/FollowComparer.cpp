@@ -0,0 +1,412 @@
+#include "FollowComparer.h"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <deque>
+#include <list>
+#include <map>
+#include <thread>
+
+#include "Progress.h"
+
+namespace rootdiff {
+
+/**
+ * Where a file being followed stands
+ */
+struct FollowState {
+  /// Name of the file
+  std::string fn;
+  /// Number of the file in log messages (1 or 2)
+  int file_num;
+  /// Offset of the first record not scanned yet
+  Long64_t cur{HEADER_LEN};
+  /// Number of records scanned so far
+  int num_obj{0};
+  /// Size of the file at the last poll
+  Long64_t size{0};
+  /// End recorded in the header at the last poll
+  Long64_t end{0};
+  /// Number of polls in a row the file looked complete
+  int stable_polls{0};
+  /// Objects not matched with an object of the other file yet
+  std::list<ObjectInfo> pending;
+  /// Path of every directory seen so far by the offset of its record
+  std::map<Long64_t, std::string> dirs{{HEADER_LEN, ""}};
+  /// Objects of every directory not checked against the other file yet,
+  /// in the order they were written
+  std::map<std::string, std::deque<ObjectInfo>> unchecked;
+  /// Scan progress reported while following, nullptr if not reported
+  ProgressFile *progress{nullptr};
+};
+
+static Long64_t file_size(const std::string &fn) {
+  struct stat st;
+  if (stat(fn.c_str(), &st) != 0) return -1;
+  return st.st_size;
+}
+
+/**
+ * How the first difference found while following shows up
+ */
+enum class Divergence { Content, Length, Order };
+
+/**
+ * Describe a difference between an object of file 1 and its counterpart
+ * in file 2
+ *
+ * @param[in] in_1 How file 1 is referred to
+ * @param[in] in_2 How file 2 is referred to
+ */
+static std::string describe(Divergence kind, const ObjectInfo &first,
+                            const ObjectInfo &second, const std::string &in_1,
+                            const std::string &in_2) {
+  std::string ret = first.class_name + " with object name " + first.obj_name +
+                    " at " + std::to_string(first.seek_key) + " in " + in_1;
+  switch (kind) {
+    case Divergence::Content:
+      return ret + " is NOT CONTENT-EQUAL to its match at " +
+             std::to_string(second.seek_key) + " in " + in_2;
+    case Divergence::Length:
+      return ret + " has " + std::to_string(first.nbytes) +
+             " bytes, its counterpart at " + std::to_string(second.seek_key) +
+             " in " + in_2 + " has " + std::to_string(second.nbytes) + " bytes";
+    default:
+      return ret + " (cycle " + std::to_string(first.cycle) + ") is where " +
+             in_2 + " has " + second.class_name + " with object name " +
+             second.obj_name + " (cycle " + std::to_string(second.cycle) +
+             ") at " + std::to_string(second.seek_key);
+  }
+}
+
+/**
+ * File the new records of a file under their directory
+ *
+ * Directory records give the path of the objects they hold, objects in a
+ * directory whose record has not been seen are not checked early.
+ *
+ * @param[in,out] infos New records, left with those not ignored
+ */
+static void track(FollowState &state, std::vector<ObjectInfo> &infos,
+                  const std::set<std::string> &ignored_classes) {
+  std::vector<ObjectInfo> kept;
+  for (auto const &info : infos) {
+    if (info.class_name == ROOT_DIR or info.class_name == "TDirectory") {
+      auto parent = state.dirs.find(info.seek_pdir);
+      if (parent != state.dirs.end() and info.seek_key != HEADER_LEN) {
+        state.dirs[info.seek_key] = parent->second + "/" + info.obj_name;
+      }
+    }
+    if (ignored_classes.count(info.class_name)) continue;
+
+    auto dir = state.dirs.find(info.seek_pdir);
+    if (dir != state.dirs.end()) state.unchecked[dir->second].push_back(info);
+    kept.push_back(info);
+  }
+  infos.swap(kept);
+}
+
+/**
+ * Offsets of the objects of a file not matched with an object of the
+ * other file yet
+ */
+static std::set<Long64_t> pending_offsets(const FollowState &state) {
+  std::set<Long64_t> ret;
+  for (auto const &info : state.pending) ret.insert(info.seek_key);
+  return ret;
+}
+
+/**
+ * Check the objects of every directory against the objects written at
+ * the same place in the same directory of the other file
+ *
+ * The pairing ignores the order and the names of the objects, so
+ * counterparts that differ only matter if one of them is unmatched. The
+ * difference is certain when both have the same class, name and cycle,
+ * are unmatched and differ in length: each is the other's copy and
+ * neither can be paired. Otherwise the match of the unmatched one may
+ * still be written, e.g. by a writer flushing its baskets in another
+ * order, and the difference is provisional.
+ *
+ * @param[out] first Object of file 1 that differs
+ * @param[out] second Its counterpart in file 2
+ * @param[out] provisional Can the objects still be matched later?
+ * @return false if no difference was found
+ */
+static bool diverging(FollowState &state_1, FollowState &state_2,
+                      Divergence &kind, ObjectInfo &first, ObjectInfo &second,
+                      bool &provisional) {
+  std::set<Long64_t> pending_1 = pending_offsets(state_1),
+                     pending_2 = pending_offsets(state_2);
+  provisional = false;
+  bool found = false;
+  for (auto &[dir, objs_1] : state_1.unchecked) {
+    auto it = state_2.unchecked.find(dir);
+    if (it == state_2.unchecked.end()) continue;
+    auto &objs_2 = it->second;
+    for (; !objs_1.empty() and !objs_2.empty();
+         objs_1.pop_front(), objs_2.pop_front()) {
+      const ObjectInfo &obj_1 = objs_1.front(), &obj_2 = objs_2.front();
+      bool order = obj_1.class_name != obj_2.class_name or
+                   obj_1.obj_name != obj_2.obj_name or
+                   obj_1.cycle != obj_2.cycle;
+      if (!order and obj_1.nbytes == obj_2.nbytes) continue;
+
+      bool open_1 = pending_1.count(obj_1.seek_key),
+           open_2 = pending_2.count(obj_2.seek_key);
+      if (!open_1 and !open_2) continue;
+      if (found and (order or !(open_1 and open_2))) continue;
+
+      kind = order ? Divergence::Order : Divergence::Length;
+      first = obj_1;
+      second = obj_2;
+      found = true;
+      provisional = order or !(open_1 and open_2);
+      if (!provisional) return true;
+    }
+  }
+  return found;
+}
+
+/**
+ * Look at a file again
+ *
+ * The header is read again on every poll since ROOT rewrites fEND and
+ * fSeekKeys in place.
+ *
+ * @return true if the file grew since the last poll
+ */
+static bool poll(FollowState &state, RootFile &f) {
+  Long64_t size = f.io().size();
+  bool has_header = f.reload_header();
+  Long64_t end = f.header().end;
+
+  bool complete = has_header and f.header().seek_keys != 0 and end == size;
+  if (complete and size == state.size and end == state.end) {
+    state.stable_polls++;
+  } else {
+    state.stable_polls = complete ? 1 : 0;
+  }
+
+  bool grew = size != state.size;
+  state.size = size;
+  state.end = end;
+  return grew;
+}
+
+AgreeLevel FollowComparer::comp(const std::string &fn_1,
+                                const std::string &fn_2,
+                                const std::string &mode,
+                                const std::string &log_fn,
+                                const std::set<std::string> &ignored_classes) const {
+  ObjectComparer obj_comp = comparer_.make_obj_comparer(mode);
+
+  std::ofstream log_f;
+  log_f.open(log_fn);
+  if (!log_f) {
+    std::cout << "cannot create log file" << std::endl;
+  }
+
+  Timer tmr;
+  FollowState state_1, state_2;
+  state_1.fn = fn_1;
+  state_1.file_num = 1;
+  state_2.fn = fn_2;
+  state_2.file_num = 2;
+
+  // Wait for both files to have a header
+  auto idle_since = std::chrono::steady_clock::now();
+  auto idle_for = [&idle_since] {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         idle_since).count();
+  };
+  while (file_size(fn_1) < HEADER_LEN or file_size(fn_2) < HEADER_LEN) {
+    if (idle_for() > FOLLOW_IDLE_SECONDS) {
+      std::cout << "Gave up waiting for " << fn_1 << " and " << fn_2
+                << " to be created." << std::endl;
+      return AgreeLevel::Not_eq;
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(FOLLOW_POLL_SECONDS));
+  }
+
+  RootFile f_1 = comparer_.open(fn_1, true);
+  RootFile f_2 = comparer_.open(fn_2, true);
+
+  Progress *progress = comparer_.progress();
+  if (progress) {
+    state_1.progress = progress->add_file(fn_1, 0);
+    state_2.progress = progress->add_file(fn_2, 0);
+  }
+
+  // The objects ignored while following are logged by the final pass
+  std::ostream no_log(nullptr);
+
+  // Directory records are needed to place the objects, they are dropped
+  // after tracking if ignored
+  std::set<std::string> scan_ignored = ignored_classes;
+  scan_ignored.erase(ROOT_DIR);
+  scan_ignored.erase("TDirectory");
+
+  EqualPairs equal_pairs;
+  CountedPairs counted;
+  bool diverged = false;
+  bool hinted = false;
+  bool timed_out = false;
+
+  auto report = [&](Divergence kind, const ObjectInfo &first,
+                    const ObjectInfo &second) {
+    diverged = true;
+    std::cout << "First difference after " << tmr.elapsed() << " s: "
+              << describe(kind, first, second, "file 1", "file 2")
+              << std::endl;
+    if (progress) {
+      progress->lower_level(obj_comp.tolerant() ? AgreeLevel::Tolerant_eq
+                                                : AgreeLevel::Logic_eq);
+      progress->difference(describe(kind, first, second, fn_1, fn_2));
+    }
+  };
+
+  while (true) {
+    bool grew_1 = poll(state_1, f_1), grew_2 = poll(state_2, f_2);
+    if (grew_1 or grew_2) idle_since = std::chrono::steady_clock::now();
+
+    // Scan what was appended to each file since the last poll
+    std::vector<ObjectInfo> new_1, new_2;
+    if (!comparer_.scan_tail(f_1, 1, scan_ignored, no_log,
+                             state_1.cur, state_1.size, new_1,
+                             state_1.num_obj) or
+        !comparer_.scan_tail(f_2, 2, scan_ignored, no_log,
+                             state_2.cur, state_2.size, new_2,
+                             state_2.num_obj)) {
+      return AgreeLevel::Not_eq;
+    }
+    track(state_1, new_1, ignored_classes);
+    track(state_2, new_2, ignored_classes);
+    for (FollowState *state : {&state_1, &state_2}) {
+      if (!state->progress) continue;
+      state->progress->size = state->size;
+      state->progress->scanned = state->cur;
+    }
+
+    // Match the new objects with the pending objects of the other file
+    std::vector<ObjectPair> objs_pair;
+    for (auto const &info : new_1) state_1.pending.push_back(info);
+    for (auto const &info_2 : new_2) {
+      bool found_match{false};
+      for (auto it = state_1.pending.begin(); it != state_1.pending.end(); ++it) {
+        if (obj_comp.logic_cmp(*it, info_2)) {
+          objs_pair.emplace_back(*it, info_2);
+          state_1.pending.erase(it);
+          found_match = true;
+          break;
+        }
+      }
+      if (not found_match) state_2.pending.push_back(info_2);
+    }
+    for (auto it_1 = state_1.pending.begin(); it_1 != state_1.pending.end();) {
+      bool found_match{false};
+      for (auto it_2 = state_2.pending.begin(); it_2 != state_2.pending.end(); ++it_2) {
+        if (obj_comp.logic_cmp(*it_1, *it_2)) {
+          objs_pair.emplace_back(*it_1, *it_2);
+          state_2.pending.erase(it_2);
+          found_match = true;
+          break;
+        }
+      }
+      it_1 = found_match ? state_1.pending.erase(it_1) : std::next(it_1);
+    }
+
+    // Compare the new pairs right away
+    if (progress) progress->add_pairs(objs_pair.size());
+    BatchedCounter compared(progress ? progress->pairs_compared() : nullptr);
+    for (auto const &[first, second] : objs_pair) {
+      compared.add(1);
+      counted.insert({first.seek_key, second.seek_key});
+      if (obj_comp.strict_cmp(first, f_1, second, f_2)) {
+        // ROOT rewrites the file and directory records in place when it
+        // closes the file, so their verdict cannot be kept
+        if (first.seek_key != HEADER_LEN and first.class_name != ROOT_DIR and
+            first.class_name != "TDirectory") {
+          equal_pairs.insert({RecordKey(first), RecordKey(second)});
+        }
+      } else if (!diverged) {
+        report(Divergence::Content, first, second);
+      }
+    }
+
+    // Objects that logic_cmp cannot pair are only unmatched at the end,
+    // their counterparts tell right away
+    ObjectInfo first, second;
+    Divergence kind;
+    bool provisional;
+    if (!diverged and
+        diverging(state_1, state_2, kind, first, second, provisional)) {
+      if (!provisional) {
+        report(kind, first, second);
+      } else if (!hinted) {
+        hinted = true;
+        std::cout << "Possible difference after " << tmr.elapsed() << " s: "
+                  << describe(kind, first, second, "file 1", "file 2")
+                  << ", unless the objects were written in another order"
+                  << std::endl;
+      }
+    }
+
+    if (debug_) {
+      std::cout << "Followed " << fn_1 << " to " << state_1.cur << " and "
+                << fn_2 << " to " << state_2.cur << ", "
+                << state_1.pending.size() + state_2.pending.size()
+                << " objects pending" << std::endl;
+    }
+
+    if (state_1.stable_polls >= FOLLOW_STABLE_POLLS and
+        state_2.stable_polls >= FOLLOW_STABLE_POLLS) {
+      break;
+    }
+    if (idle_for() > FOLLOW_IDLE_SECONDS) {
+      timed_out = true;
+      break;
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(FOLLOW_POLL_SECONDS));
+  }
+  if (progress) {
+    progress->finish_file(state_1.progress);
+    progress->finish_file(state_2.progress);
+  }
+
+  if (timed_out) {
+    std::cout << "Files stopped growing for " << FOLLOW_IDLE_SECONDS
+              << " s before being completed." << std::endl;
+    log_f << "Files stopped growing for " << FOLLOW_IDLE_SECONDS
+          << " s before being completed" << std::endl;
+    return AgreeLevel::Not_eq;
+  }
+
+  // Both files are complete, redo the scan with the final file headers,
+  // only read the pairs not known to be equal yet and only count the pairs
+  // not compared while following
+  RootFile g_1 = comparer_.open(fn_1);
+  RootFile g_2 = comparer_.open(fn_2);
+
+  CompareStats stats;
+  std::vector<ObjectPair> objs_pair;
+  if (!comparer_.match(g_1, g_2, ignored_classes, log_f, objs_pair, stats,
+                       &counted)) {
+    return AgreeLevel::Not_eq;
+  }
+  comparer_.compare_pairs(obj_comp, g_1, g_2, objs_pair.begin(),
+                          objs_pair.end(), log_f, stats, &equal_pairs,
+                          &counted);
+  stats.io_1.merge(f_1.io().stats());
+  stats.io_1.merge(g_1.io().stats());
+  stats.io_2.merge(f_2.io().stats());
+  stats.io_2.merge(g_2.io().stats());
+  comparer_.summarize(log_f, stats, tmr.elapsed());
+  log_f.close();
+
+  return stats.level();
+}
+
+}  // namespace rootdiff
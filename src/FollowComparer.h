@@ -0,0 +1,75 @@
+#ifndef ROOT_DIFF_FOLLOW_COMPARATOR
+#define ROOT_DIFF_FOLLOW_COMPARATOR
+
+#include <set>
+#include <string>
+
+#include "FileComparer.h"
+
+/**
+ * Seconds between two looks at the files being followed
+ */
+#define FOLLOW_POLL_SECONDS 1
+
+/**
+ * A file is complete once its header records the keys list and an end
+ * equal to its size for this many polls in a row.
+ */
+#define FOLLOW_STABLE_POLLS 3
+
+/**
+ * Give up following files that have not grown for this many seconds
+ * without being completed.
+ */
+#define FOLLOW_IDLE_SECONDS 600
+
+namespace rootdiff {
+
+/**
+ * Compare two root files while they are still being written
+ *
+ * The records appended past the last known offset of each file are
+ * scanned on every poll, matched against the pending records of the
+ * other file and compared right away, so that the first difference is
+ * reported as soon as both copies of an object are on disk. Objects
+ * without a match are only reported at the end. Once both
+ * files are complete they are scanned again from the start, since ROOT
+ * writes the keys list at the end and may reuse free segments, and the
+ * final result is the one of FileComparer::comp. Pairs already found
+ * content-equal are not read again.
+ */
+class FollowComparer {
+ public:
+  /**
+   * Constructor
+   *
+   * @param[in] comparer File comparator used for the scans and the final pass
+   * @param[in] debug Print where the files stand after every poll
+   */
+  FollowComparer(const FileComparer &comparer, bool debug)
+      : comparer_(comparer), debug_(debug) {}
+
+  /*
+   * Follow two root files until both are complete and return the
+   * agreement level of the comparison
+   *
+   * The first difference is printed to stdout as soon as it is found.
+   *
+   * @param[in] fn_1 Name of file 1
+   * @param[in] fn_2 Name of file 2
+   * @param[in] mode Mode of comparison
+   * @param[in] log_fn Name of log file
+   * @param[in] ignored_classes set of class names to ignore during comparison
+   */
+  AgreeLevel comp(const std::string &fn_1, const std::string &fn_2,
+                  const std::string &mode, const std::string &log_fn,
+                  const std::set<std::string> &ignored_classes) const;
+
+ private:
+  const FileComparer &comparer_;
+  bool debug_;
+};
+
+}  // namespace rootdiff
+
+#endif
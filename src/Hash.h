@@ -0,0 +1,41 @@
+#ifndef ROOT_DIFF_HASH
+#define ROOT_DIFF_HASH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace rootdiff {
+
+/**
+ * Fast non-cryptographic 64 bit hash of a buffer
+ *
+ * Mixes eight bytes at a time with a multiply and rotate, then folds
+ * in the tail and the length.
+ */
+inline uint64_t hash_bytes(const void *data, std::size_t len) {
+  const uint64_t k = 0x9e3779b97f4a7c15ULL;
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t h = 0xcbf29ce484222325ULL ^ (len * k);
+
+  std::size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    h ^= w * k;
+    h = ((h << 31) | (h >> 33)) * 0xff51afd7ed558ccdULL;
+  }
+
+  uint64_t tail = 0;
+  memcpy(&tail, p + i, len - i);
+  h ^= tail * k;
+
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+}  // namespace rootdiff
+
+#endif
@@ -0,0 +1,346 @@
+#include "IOBackend.h"
+
+#include <aio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TFile.h"
+#include "Timer.h"
+
+namespace rootdiff {
+
+IOBackendType io_backend_type(const std::string &name) {
+  if (name == "tfile") return IOBackendType::TFile;
+  if (name == "pread") return IOBackendType::Pread;
+  if (name == "mmap") return IOBackendType::Mmap;
+  if (name == "async") return IOBackendType::Async;
+  std::cerr << "Unrecognized I/O backend '" << name << "'" << std::endl;
+  throw std::exception();
+}
+
+const char *io_backend_name(IOBackendType type) {
+  switch (type) {
+    case IOBackendType::Pread: return "pread";
+    case IOBackendType::Mmap: return "mmap";
+    case IOBackendType::Async: return "async";
+    default: return "tfile";
+  }
+}
+
+bool IOBackend::read(char *buf, Long64_t offset, Long64_t len) {
+  Timer tmr;
+  bool ok = do_read(buf, offset, len);
+  stats_.n_reads++;
+  stats_.n_bytes += len;
+  stats_.seconds += tmr.elapsed();
+  return ok;
+}
+
+/**
+ * Open a local file for reading
+ */
+static int open_fd(const std::string &fn) {
+  int fd = open(fn.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Cannot open " << fn << ": " << strerror(errno) << std::endl;
+    throw std::exception();
+  }
+  return fd;
+}
+
+static Long64_t fd_size(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) return -1;
+  return st.st_size;
+}
+
+/**
+ * Read through ROOT
+ */
+class TFileBackend : public IOBackend {
+ public:
+  TFileBackend(const std::string &fn) : f_(fn.c_str()) {
+    if (f_.IsZombie()) {
+      std::cerr << "Cannot open " << fn << " with ROOT" << std::endl;
+      throw std::exception();
+    }
+  }
+
+  Long64_t size() override { return f_.GetSize(); }
+  TFile *tfile() override { return &f_; }
+
+ protected:
+  bool do_read(char *buf, Long64_t offset, Long64_t len) override {
+    f_.Seek(offset);
+    return !f_.ReadBuffer(buf, len);
+  }
+
+ private:
+  TFile f_;
+};
+
+/**
+ * Read a local file with pread(2)
+ */
+class PreadBackend : public IOBackend {
+ public:
+  PreadBackend(const std::string &fn) : fd_(open_fd(fn)) {}
+  ~PreadBackend() { close(fd_); }
+
+  Long64_t size() override { return fd_size(fd_); }
+
+ protected:
+  bool do_read(char *buf, Long64_t offset, Long64_t len) override {
+    while (len > 0) {
+      ssize_t n = pread(fd_, buf, len, offset);
+      if (n < 0 and errno == EINTR) continue;
+      if (n <= 0) return false;
+      buf += n;
+      offset += n;
+      len -= n;
+    }
+    return true;
+  }
+
+ private:
+  int fd_;
+};
+
+/**
+ * Copy out of a read-only mapping of a local file
+ *
+ * The mapping is redone when a read goes past its end, since a file that
+ * is still being written grows after it was mapped.
+ */
+class MmapBackend : public IOBackend {
+ public:
+  MmapBackend(const std::string &fn) : fd_(open_fd(fn)) { remap(); }
+  ~MmapBackend() {
+    if (map_) munmap(map_, map_len_);
+    close(fd_);
+  }
+
+  Long64_t size() override { return fd_size(fd_); }
+
+ protected:
+  bool do_read(char *buf, Long64_t offset, Long64_t len) override {
+    if (offset < 0) return false;
+    if (offset + len > map_len_ and !remap()) return false;
+    if (offset + len > map_len_) return false;
+    memcpy(buf, (char *)map_ + offset, len);
+    return true;
+  }
+
+ private:
+  bool remap() {
+    Long64_t len = fd_size(fd_);
+    if (len <= map_len_) return len == map_len_;
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map == MAP_FAILED) return false;
+    if (map_) munmap(map_, map_len_);
+    map_ = map;
+    map_len_ = len;
+    return true;
+  }
+
+ private:
+  int fd_;
+  void *map_{nullptr};
+  Long64_t map_len_{0};
+};
+
+/**
+ * Read a local file with POSIX AIO
+ *
+ * Records are mostly read in file order, so a read that is not in the
+ * bytes read ahead starts reading the ASYNC_READAHEAD_BYTES after it in
+ * the background, and the following reads are served from them until one
+ * goes past their end.
+ */
+class AsyncBackend : public IOBackend {
+ public:
+  AsyncBackend(const std::string &fn)
+      : fd_(open_fd(fn)), ahead_(ASYNC_READAHEAD_BYTES) {}
+  ~AsyncBackend() {
+    wait_ahead();
+    close(fd_);
+  }
+
+  Long64_t size() override { return fd_size(fd_); }
+
+  void drop_cache() override {
+    wait_ahead();
+    ahead_len_ = 0;
+  }
+
+ protected:
+  bool do_read(char *buf, Long64_t offset, Long64_t len) override {
+    bool ahead = offset >= ahead_offset_ and
+                 offset + len <= ahead_offset_ + ASYNC_READAHEAD_BYTES;
+    if (ahead) wait_ahead();
+
+    if (ahead and offset + len <= ahead_offset_ + ahead_len_) {
+      memcpy(buf, ahead_.data() + (offset - ahead_offset_), len);
+      return true;
+    }
+    bool ok = read_now(buf, offset, len);
+
+    // the buffer is in use until the read ahead is done
+    wait_ahead();
+    ahead_offset_ = offset + len;
+    ahead_len_ = 0;
+    memset(&ahead_cb_, 0, sizeof(ahead_cb_));
+    ahead_cb_.aio_fildes = fd_;
+    ahead_cb_.aio_buf = ahead_.data();
+    ahead_cb_.aio_nbytes = ahead_.size();
+    ahead_cb_.aio_offset = ahead_offset_;
+    in_flight_ = aio_read(&ahead_cb_) == 0;
+    return ok;
+  }
+
+ private:
+  /// wait for a request, return the number of bytes read or -1
+  static ssize_t wait(struct aiocb &cb) {
+    const struct aiocb *list[1] = {&cb};
+    while (aio_error(&cb) == EINPROGRESS) {
+      aio_suspend(list, 1, NULL);
+    }
+    return aio_return(&cb);
+  }
+
+  void wait_ahead() {
+    if (!in_flight_) return;
+    ssize_t n = wait(ahead_cb_);
+    ahead_len_ = n < 0 ? 0 : n;
+    in_flight_ = false;
+  }
+
+  bool read_now(char *buf, Long64_t offset, Long64_t len) {
+    while (len > 0) {
+      struct aiocb cb;
+      memset(&cb, 0, sizeof(cb));
+      cb.aio_fildes = fd_;
+      cb.aio_buf = buf;
+      cb.aio_nbytes = len;
+      cb.aio_offset = offset;
+      if (aio_read(&cb) != 0) return false;
+      ssize_t n = wait(cb);
+      if (n <= 0) return false;
+      buf += n;
+      offset += n;
+      len -= n;
+    }
+    return true;
+  }
+
+ private:
+  int fd_;
+  std::vector<char> ahead_;
+  struct aiocb ahead_cb_;
+  bool in_flight_{false};
+  /// offset of the bytes read ahead and how many of them were read
+  Long64_t ahead_offset_{-1};
+  Long64_t ahead_len_{0};
+};
+
+/**
+ * Bandwidth of the simulated storage of one file, shared by every backend
+ * reading it
+ */
+struct Throttle {
+  std::mutex mtx;
+  /// when the bytes of the requests already made are all transferred
+  std::chrono::steady_clock::time_point free_at;
+};
+
+/**
+ * Throttle of a file, the same for every backend opening the same path
+ */
+static std::shared_ptr<Throttle> throttle_of(const std::string &fn) {
+  static std::mutex mtx;
+  static std::map<std::string, std::weak_ptr<Throttle>> throttles;
+  std::lock_guard<std::mutex> lock(mtx);
+  std::shared_ptr<Throttle> throttle = throttles[fn].lock();
+  if (!throttle) {
+    throttle = std::make_shared<Throttle>();
+    throttles[fn] = throttle;
+  }
+  return throttle;
+}
+
+/**
+ * Slow down the reads of another backend to simulate remote storage
+ *
+ * Every request waits for the latency plus the time its bytes take at
+ * the bandwidth cap, on top of the time of the actual read. The requests
+ * of all the backends of a file queue for the same bandwidth, so threads
+ * reading a file together get no more than the cap.
+ */
+class SimulatedBackend : public IOBackend {
+ public:
+  SimulatedBackend(std::unique_ptr<IOBackend> io, double latency_ms,
+                   double bandwidth_mbps, std::shared_ptr<Throttle> throttle)
+      : io_(std::move(io)),
+        latency_ms_(latency_ms),
+        bandwidth_mbps_(bandwidth_mbps),
+        throttle_(std::move(throttle)) {}
+
+  Long64_t size() override { return io_->size(); }
+  void drop_cache() override { io_->drop_cache(); }
+  TFile *tfile() override { return io_->tfile(); }
+
+ protected:
+  bool do_read(char *buf, Long64_t offset, Long64_t len) override {
+    auto done = std::chrono::steady_clock::now();
+    if (bandwidth_mbps_ > 0.) {
+      auto transfer = std::chrono::duration_cast<
+          std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+          len / (bandwidth_mbps_ * (1 << 20))));
+      std::lock_guard<std::mutex> lock(throttle_->mtx);
+      if (throttle_->free_at > done) done = throttle_->free_at;
+      done += transfer;
+      throttle_->free_at = done;
+    }
+    done += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(latency_ms_ / 1e3));
+    std::this_thread::sleep_until(done);
+    return io_->read(buf, offset, len);
+  }
+
+ private:
+  std::unique_ptr<IOBackend> io_;
+  double latency_ms_;
+  double bandwidth_mbps_;
+  std::shared_ptr<Throttle> throttle_;
+};
+
+std::unique_ptr<IOBackend> open_backend(const IOConfig &config,
+                                        const std::string &fn) {
+  std::unique_ptr<IOBackend> io;
+  switch (config.type) {
+    case IOBackendType::Pread: io.reset(new PreadBackend(fn)); break;
+    case IOBackendType::Mmap: io.reset(new MmapBackend(fn)); break;
+    case IOBackendType::Async: io.reset(new AsyncBackend(fn)); break;
+    default: io.reset(new TFileBackend(fn)); break;
+  }
+
+  if (config.simulated()) {
+    io.reset(new SimulatedBackend(std::move(io), config.latency_ms,
+                                  config.bandwidth_mbps, throttle_of(fn)));
+  }
+  return io;
+}
+
+}  // namespace rootdiff
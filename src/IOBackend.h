@@ -0,0 +1,134 @@
+#ifndef ROOT_DIFF_IO_BACKEND
+#define ROOT_DIFF_IO_BACKEND
+
+#include <memory>
+#include <string>
+
+#include "RtypesCore.h"
+
+class TFile;
+
+/**
+ * Bytes read ahead by the async backend
+ */
+#define ASYNC_READAHEAD_BYTES (1 << 20)
+
+namespace rootdiff {
+
+/**
+ * How the bytes of a file are read
+ * 1. TFILE - TFile::Seek and TFile::ReadBuffer, works for every URL ROOT
+ *    can open
+ * 2. PREAD - pread(2) on a local file
+ * 3. MMAP - copy out of a read-only mapping of a local file
+ * 4. ASYNC - POSIX AIO on a local file, reading the next block ahead
+ *    while the current one is used
+ */
+enum class IOBackendType { TFile, Pread, Mmap, Async };
+
+/**
+ * Backend of a name given on the command line (tfile, pread, mmap, async)
+ *
+ * Throws if the name is not one of them.
+ */
+IOBackendType io_backend_type(const std::string &name);
+
+/**
+ * Name of a backend as printed in reports
+ */
+const char *io_backend_name(IOBackendType type);
+
+/**
+ * Read counters of a backend
+ */
+struct IOStats {
+  /// Number of read requests
+  Long64_t n_reads{0};
+  /// Number of bytes requested
+  Long64_t n_bytes{0};
+  /// Wall time spent in the reads
+  double seconds{0.};
+
+  /**
+   * Add the counters of another backend reading the same file
+   */
+  void merge(const IOStats &other) {
+    n_reads += other.n_reads;
+    n_bytes += other.n_bytes;
+    seconds += other.seconds;
+  }
+};
+
+/**
+ * Backend and simulated storage used to open every file
+ */
+struct IOConfig {
+  IOBackendType type{IOBackendType::TFile};
+  /// Latency added to every read request, in milliseconds
+  double latency_ms{0.};
+  /// Bandwidth every file is capped at, in MB/s, 0 for no cap
+  double bandwidth_mbps{0.};
+
+  /// are the reads slowed down to simulate remote storage?
+  bool simulated() const { return latency_ms > 0. or bandwidth_mbps > 0.; }
+};
+
+/**
+ * Source of the bytes of one file
+ *
+ * A backend is used by one thread at a time, threads reading the same
+ * file open their own.
+ */
+class IOBackend {
+ public:
+  virtual ~IOBackend() {}
+
+  /**
+   * Read len bytes at offset into buf
+   *
+   * @return false if the bytes could not all be read
+   */
+  bool read(char *buf, Long64_t offset, Long64_t len);
+
+  /**
+   * Current size of the file, -1 if it cannot be found
+   */
+  virtual Long64_t size() = 0;
+
+  /**
+   * Forget the bytes read ahead, for files that are still being written
+   */
+  virtual void drop_cache() {}
+
+  /**
+   * The TFile read by this backend, nullptr if it does not read through ROOT
+   */
+  virtual TFile *tfile() { return nullptr; }
+
+  /// read counters of this backend
+  const IOStats &stats() const { return stats_; }
+
+  /**
+   * Count the reads of other backends of the same file, e.g. the ones of
+   * the threads of a parallel scan
+   */
+  void add_stats(const IOStats &other) { stats_.merge(other); }
+
+ protected:
+  virtual bool do_read(char *buf, Long64_t offset, Long64_t len) = 0;
+
+ private:
+  IOStats stats_;
+};
+
+/**
+ * Open a file with the backend of the configuration
+ *
+ * Throws if the file cannot be opened.
+ */
+std::unique_ptr<IOBackend> open_backend(const IOConfig &config,
+                                        const std::string &fn);
+
+}  // namespace rootdiff
+
+#endif
@@ -0,0 +1,318 @@
+#include "MergeVerifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <memory>
+
+#include "TClass.h"
+#include "TDirectory.h"
+#include "TH1.h"
+#include "TKey.h"
+#include "TROOT.h"
+#include "ThreadPool.h"
+
+namespace rootdiff {
+
+/**
+ * A TBasket found while indexing a file
+ */
+struct Basket {
+  ObjectInfo info;
+  Fingerprint fingerprint;
+};
+
+/**
+ * Key index of one file of a merge
+ */
+struct MergeIndex {
+  /// Name of the file
+  std::string fn;
+  /// The file, open from the check of the compression settings until it
+  /// is indexed
+  std::unique_ptr<RootFile> f;
+  /// Why the file could not be indexed, empty if it was
+  std::string note;
+  /// Baskets in file order
+  std::vector<Basket> baskets;
+  /// Bin contents of every histogram by path, under- and overflow included
+  std::map<std::string, std::vector<double>> hists;
+  /// Number of records that are neither baskets nor histograms by class
+  std::map<std::string, int> unchecked;
+  /// Reads of the file
+  IOStats io;
+};
+
+/**
+ * Recursively read the bin contents of the histograms of a directory
+ *
+ * @param[in] prefix Path of the directory, empty or ending with a slash
+ */
+static void collect_hists(TDirectory *dir, const std::string &prefix,
+                          std::map<std::string, std::vector<double>> &hists) {
+  TIter next(dir->GetListOfKeys());
+  while (TKey *key = (TKey *)next()) {
+    std::string path = prefix + key->GetName();
+    if (strcmp(key->GetClassName(), ROOT_DIR) == 0) {
+      TDirectory *sub = dir->GetDirectory(key->GetName());
+      if (sub) collect_hists(sub, path + "/", hists);
+      continue;
+    }
+
+    // keys of the same name are listed from the highest cycle down
+    if (hists.count(path)) continue;
+    TClass *cl = TClass::GetClass(key->GetClassName());
+    if (!cl or !cl->InheritsFrom(TH1::Class())) continue;
+
+    TH1 *h = dynamic_cast<TH1 *>(key->ReadObj());
+    if (!h) continue;
+    std::vector<double> &bins = hists[path];
+    for (Int_t i = 0; i < h->GetNcells(); i++) {
+      bins.push_back(h->GetBinContent(i));
+    }
+    delete h;
+  }
+}
+
+/**
+ * Index the baskets and histograms of one file
+ *
+ * The records are read once, in file order, and the payload of every
+ * TBasket is hashed as it is read. The histograms are then read through
+ * ROOT. The file is closed once indexed.
+ *
+ * @param[in] compressed Are baskets compared by their compressed payload?
+ */
+static void index_file(const FileComparer &comparer,
+                       const ObjectComparer &obj_comp, bool compressed,
+                       MergeIndex &index) {
+  try {
+    RootFile &f = *index.f;
+
+    bool ok = comparer.stream(f, [&](const ObjectInfo &info, char *payload) {
+      if (info.class_name == "TBasket") {
+        Long64_t len = compressed ? info.nbytes - info.key_len : info.obj_len;
+        index.baskets.push_back({info, {len, obj_comp.payload_hash(info, payload)}});
+        return;
+      }
+      TClass *cl = TClass::GetClass(info.class_name.c_str());
+      if (!cl or !cl->InheritsFrom(TH1::Class())) {
+        index.unchecked[info.class_name]++;
+      }
+    });
+    if (!ok) {
+      index.note = "cannot read the records";
+      return;
+    }
+
+    collect_hists(&f.tfile(), "", index.hists);
+    index.io = f.io().stats();
+  } catch (...) {
+    index.note = "cannot be read";
+  }
+  index.f.reset();
+}
+
+/**
+ * Compare the histograms of the merged file with the sums of the inputs
+ *
+ * @param[out] n_hists Number of histograms of the merged file
+ * @return number of histograms that differ, are missing in the merged
+ * file or are not in any input
+ */
+static int check_hists(const std::vector<MergeIndex> &indexes,
+                       std::ostream &log_f, int &n_hists) {
+  const MergeIndex &merged = indexes[0];
+  int n_bad = 0;
+  n_hists = merged.hists.size();
+
+  for (auto const &[path, bins] : merged.hists) {
+    std::vector<double> sum(bins.size(), 0.);
+    bool found = false, same_bins = true;
+    for (std::size_t i = 1; i < indexes.size(); i++) {
+      auto it = indexes[i].hists.find(path);
+      if (it == indexes[i].hists.end()) continue;
+      found = true;
+      if (it->second.size() != bins.size()) {
+        log_f << "Histogram " << path << " has " << it->second.size()
+              << " bins in " << indexes[i].fn << " but " << bins.size()
+              << " in the merged file" << std::endl;
+        same_bins = false;
+        break;
+      }
+      for (std::size_t b = 0; b < bins.size(); b++) sum[b] += it->second[b];
+    }
+
+    if (!found) {
+      log_f << "Histogram " << path << " of the merged file is not in any input"
+            << std::endl;
+      n_bad++;
+      continue;
+    }
+    if (!same_bins) {
+      n_bad++;
+      continue;
+    }
+
+    for (std::size_t b = 0; b < bins.size(); b++) {
+      double scale = std::max(std::fabs(bins[b]), std::fabs(sum[b]));
+      if (std::fabs(bins[b] - sum[b]) > MERGE_BIN_REL_EPS * scale) {
+        log_f << "Bin " << b << " of histogram " << path << " is " << bins[b]
+              << " in the merged file but the inputs sum to " << sum[b]
+              << std::endl;
+        n_bad++;
+        break;
+      }
+    }
+  }
+
+  std::set<std::string> missing;
+  for (std::size_t i = 1; i < indexes.size(); i++) {
+    for (auto const &[path, bins] : indexes[i].hists) {
+      if (merged.hists.count(path) or !missing.insert(path).second) continue;
+      log_f << "Histogram " << path << " of " << indexes[i].fn
+            << " is missing in the merged file" << std::endl;
+      n_bad++;
+    }
+  }
+
+  return n_bad;
+}
+
+bool MergeVerifier::comp(const std::string &merged_fn,
+                         const std::vector<std::string> &input_fns,
+                         const std::string &log_fn) const {
+  std::vector<MergeIndex> indexes(input_fns.size() + 1);
+  indexes[0].fn = merged_fn;
+  for (std::size_t i = 0; i < input_fns.size(); i++) {
+    indexes[i + 1].fn = input_fns[i];
+  }
+
+  // Files are read from several threads at once
+  ROOT::EnableThreadSafety();
+
+  Timer tmr;
+
+  // hadd copies the baskets as they are unless it has to recompress them
+  // for a different compression setting
+  bool compressed = true;
+  for (auto &index : indexes) {
+    try {
+      index.f.reset(new RootFile(comparer_.open(index.fn)));
+    } catch (...) {
+      index.note = "cannot be read";
+      continue;
+    }
+    if (indexes[0].f and
+        index.f->header().compress != indexes[0].f->header().compress) {
+      compressed = false;
+    }
+  }
+  ObjectComparer obj_comp = comparer_.make_obj_comparer(compressed ? "CC" : "UC");
+
+  {
+    ThreadPool pool(n_threads_);
+    for (auto &index : indexes) {
+      if (!index.f) continue;
+      pool.submit([this, &obj_comp, compressed, &index] {
+        index_file(comparer_, obj_comp, compressed, index);
+      });
+    }
+    pool.wait();
+  }
+
+  std::ofstream log_f(log_fn);
+  if (!log_f) {
+    std::cout << "cannot create log file" << std::endl;
+  }
+
+  bool ok = true;
+  for (auto const &index : indexes) {
+    if (!index.note.empty()) {
+      log_f << index.fn << ": " << index.note << std::endl;
+      ok = false;
+    }
+  }
+  if (!ok) return false;
+
+  // Every input basket uses up one copy in the merged file
+  const MergeIndex &merged = indexes[0];
+  std::map<Fingerprint, int> copies;
+  for (auto const &basket : merged.baskets) copies[basket.fingerprint]++;
+
+  int n_input_baskets = 0, n_found = 0, n_extra = 0;
+  for (std::size_t i = 1; i < indexes.size(); i++) {
+    for (auto const &basket : indexes[i].baskets) {
+      n_input_baskets++;
+      auto it = copies.find(basket.fingerprint);
+      if (it != copies.end() and it->second > 0) {
+        it->second--;
+        n_found++;
+        continue;
+      }
+      log_f << "TBasket with object name " << basket.info.obj_name << " at "
+            << basket.info.seek_key << " in " << indexes[i].fn
+            << " has no copy in the merged file" << std::endl;
+      ok = false;
+    }
+  }
+
+  for (auto const &basket : merged.baskets) {
+    auto it = copies.find(basket.fingerprint);
+    if (it->second == 0) continue;
+    it->second--;
+    n_extra++;
+    log_f << "TBasket with object name " << basket.info.obj_name << " at "
+          << basket.info.seek_key << " in the merged file is not in any input"
+          << std::endl;
+    ok = false;
+  }
+
+  int n_hists = 0;
+  int n_bad_hists = check_hists(indexes, log_f, n_hists);
+  if (n_bad_hists) ok = false;
+
+  log_f << std::endl;
+  log_f << "================= Merge summary =================" << std::endl;
+  log_f << "Time elapsed: " << tmr.elapsed() << std::endl;
+  log_f << "Number of input files: " << input_fns.size() << std::endl;
+  log_f << "Baskets compared by the hash of their "
+        << (compressed ? "compressed" : "decompressed") << " payload"
+        << std::endl;
+  log_f << "Number of baskets in the inputs: " << n_input_baskets << std::endl;
+  log_f << "Number of baskets in the merged file: " << merged.baskets.size()
+        << std::endl;
+  log_f << "Number of input baskets found in the merged file: " << n_found
+        << std::endl;
+  log_f << "Number of merged baskets not in any input: " << n_extra
+        << std::endl;
+  log_f << "Number of histograms in the merged file: " << n_hists << std::endl;
+  log_f << "Number of histograms that are not the sums of the inputs: "
+        << n_bad_hists << std::endl;
+  std::map<std::string, int> unchecked;
+  for (auto const &index : indexes) {
+    for (auto const &[class_name, n] : index.unchecked) unchecked[class_name] += n;
+  }
+  log_f << "Records that are neither baskets nor histograms, not checked:"
+        << (unchecked.empty() ? " none" : "") << std::endl;
+  for (auto const &[class_name, n] : unchecked) {
+    log_f << "  " << class_name << ": " << n << std::endl;
+  }
+  CacheStats cache = ContentCache::instance().stats();
+  if (ContentCache::instance().enabled() and cache.used()) {
+    log_f << "Content cache: " << cache.hits << " hits, " << cache.misses
+          << " misses" << std::endl;
+  }
+  for (auto const &index : indexes) {
+    log_f << "Reads of " << index.fn << ": " << index.io.n_reads
+          << " requests, " << index.io.n_bytes << " bytes, "
+          << index.io.seconds << " s" << std::endl;
+  }
+  log_f.close();
+
+  return ok;
+}
+
+}  // namespace rootdiff
@@ -0,0 +1,64 @@
+#ifndef ROOT_DIFF_MERGE_VERIFIER
+#define ROOT_DIFF_MERGE_VERIFIER
+
+#include <string>
+#include <vector>
+
+#include "FileComparer.h"
+
+/**
+ * Largest difference between a bin of a merged histogram and the sum of
+ * the bins of the inputs, relative to the larger of the two, that is
+ * still equal. Sums of single precision bins are rounded differently
+ * depending on the order in which the inputs were added.
+ */
+#define MERGE_BIN_REL_EPS 1e-5
+
+namespace rootdiff {
+
+/**
+ * Verify that the output of hadd holds exactly the data of its inputs
+ *
+ * The key index of every file is built in its own task on a thread pool.
+ * The records of each file are read once, in file order, hashing the
+ * TBasket payloads as they are read, and its histograms are then read
+ * through ROOT. Other records are not checked. Every input basket must have
+ * a copy in the merged file and the merged file must not have any other
+ * basket. Baskets are compared by the hash of their compressed payload
+ * when all the files share the merged file's compression setting, and by
+ * the hash of their decompressed payload otherwise, since hadd then
+ * recompresses them. Every bin of a merged histogram must equal the sum
+ * of that bin in the inputs.
+ */
+class MergeVerifier {
+ public:
+  /**
+   * Constructor
+   *
+   * @param[in] comparer File comparator used to open and scan the files
+   * @param[in] n_threads Number of worker threads
+   */
+  MergeVerifier(const FileComparer &comparer, unsigned int n_threads)
+      : comparer_(comparer), n_threads_(n_threads) {}
+
+  /*
+   * Verify a merged file against its inputs
+   *
+   * @param[in] merged_fn Name of the merged file
+   * @param[in] input_fns Names of the input files
+   * @param[in] log_fn Name of log file
+   * @return true if the merged file holds exactly the baskets of the
+   * inputs and its histograms are the sums of theirs
+   */
+  bool comp(const std::string &merged_fn,
+            const std::vector<std::string> &input_fns,
+            const std::string &log_fn) const;
+
+ private:
+  const FileComparer &comparer_;
+  unsigned int n_threads_;
+};
+
+}  // namespace rootdiff
+
+#endif
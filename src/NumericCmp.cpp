@@ -0,0 +1,203 @@
+#include "NumericCmp.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ROOT_DIFF_AVX2
+#include <immintrin.h>
+#endif
+
+namespace rootdiff {
+
+static inline float load_float_be(const unsigned char *p) {
+  uint32_t u;
+  memcpy(&u, p, sizeof(u));
+  u = __builtin_bswap32(u);
+  float x;
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+static inline double load_double_be(const unsigned char *p) {
+  uint64_t u;
+  memcpy(&u, p, sizeof(u));
+  u = __builtin_bswap64(u);
+  double x;
+  memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+/**
+ * Scalar kernel, also used for the tail of the vectorized kernels
+ */
+template <typename T, T (*load)(const unsigned char *)>
+static void compare_scalar(const unsigned char *a, const unsigned char *b,
+                           std::size_t n, double abs_eps, double rel_eps,
+                           Deviation &dev) {
+  double max_abs = dev.max_abs, max_rel = dev.max_rel;
+  Long64_t n_outside = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    const unsigned char *pa = a + i * sizeof(T), *pb = b + i * sizeof(T);
+    // bitwise equal values agree, even NaN and infinities
+    if (memcmp(pa, pb, sizeof(T)) == 0) continue;
+
+    double x = load(pa), y = load(pb);
+    double diff = std::fabs(x - y);
+    double mag = std::fmax(std::fabs(x), std::fabs(y));
+    // a NaN difference compares false, so it is counted as outside
+    n_outside += !(diff <= abs_eps + rel_eps * mag);
+    max_abs = diff > max_abs ? diff : max_abs;
+    double rel = mag > 0. ? diff / mag : 0.;
+    max_rel = rel > max_rel ? rel : max_rel;
+  }
+  dev.max_abs = max_abs;
+  dev.max_rel = max_rel;
+  dev.n_outside += n_outside;
+  dev.n_values += n;
+}
+
+#ifdef ROOT_DIFF_AVX2
+
+// The AVX2 kernels are compiled for AVX2 whatever the build flags and
+// only called when the CPU running the program supports it
+
+__attribute__((target("avx2"))) static inline double hmax_pd(__m256d v) {
+  __m128d m = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  m = _mm_max_pd(m, _mm_unpackhi_pd(m, m));
+  return _mm_cvtsd_f64(m);
+}
+
+/**
+ * Compare four pairs of values already widened to double
+ *
+ * @param[in] same Lanes whose raw bits are equal, all ones if so
+ */
+__attribute__((target("avx2"))) static inline void compare_lanes(__m256d x, __m256d y, __m256d same,
+                                 __m256d abs_eps, __m256d rel_eps,
+                                 __m256d &max_abs, __m256d &max_rel,
+                                 Long64_t &n_outside) {
+  const __m256d sign = _mm256_set1_pd(-0.);
+  __m256d diff = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+  __m256d mag = _mm256_max_pd(_mm256_andnot_pd(sign, x), _mm256_andnot_pd(sign, y));
+  diff = _mm256_andnot_pd(same, diff);
+
+  __m256d tol = _mm256_add_pd(abs_eps, _mm256_mul_pd(rel_eps, mag));
+  __m256d inside = _mm256_or_pd(same, _mm256_cmp_pd(diff, tol, _CMP_LE_OQ));
+  n_outside += 4 - __builtin_popcount(_mm256_movemask_pd(inside));
+
+  // max_pd returns its second operand for NaN, so NaN differences are
+  // counted as outside but do not spoil the maxima
+  max_abs = _mm256_max_pd(diff, max_abs);
+  __m256d rel = _mm256_div_pd(diff, mag);
+  rel = _mm256_and_pd(rel, _mm256_cmp_pd(mag, _mm256_setzero_pd(), _CMP_GT_OQ));
+  max_rel = _mm256_max_pd(rel, max_rel);
+}
+
+__attribute__((target("avx2"))) static void compare_float_avx2(
+    const unsigned char *a, const unsigned char *b, std::size_t n,
+    double abs_eps, double rel_eps, Deviation &dev) {
+  const __m256i bswap = _mm256_setr_epi8(
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+      3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  const __m256d v_abs = _mm256_set1_pd(abs_eps), v_rel = _mm256_set1_pd(rel_eps);
+  __m256d max_abs = _mm256_set1_pd(dev.max_abs), max_rel = _mm256_set1_pd(dev.max_rel);
+  Long64_t n_outside = 0;
+
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i ra = _mm256_loadu_si256((const __m256i *)(a + 4 * i));
+    __m256i rb = _mm256_loadu_si256((const __m256i *)(b + 4 * i));
+    __m256i eq = _mm256_cmpeq_epi32(ra, rb);
+    if (_mm256_movemask_epi8(eq) == -1) continue;
+
+    __m256 fa = _mm256_castsi256_ps(_mm256_shuffle_epi8(ra, bswap));
+    __m256 fb = _mm256_castsi256_ps(_mm256_shuffle_epi8(rb, bswap));
+    // widen each 32 bit lane mask to 64 bits
+    __m256d same_lo = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(eq)));
+    __m256d same_hi = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(eq, 1)));
+
+    compare_lanes(_mm256_cvtps_pd(_mm256_castps256_ps128(fa)),
+                  _mm256_cvtps_pd(_mm256_castps256_ps128(fb)), same_lo,
+                  v_abs, v_rel, max_abs, max_rel, n_outside);
+    compare_lanes(_mm256_cvtps_pd(_mm256_extractf128_ps(fa, 1)),
+                  _mm256_cvtps_pd(_mm256_extractf128_ps(fb, 1)), same_hi,
+                  v_abs, v_rel, max_abs, max_rel, n_outside);
+  }
+
+  dev.max_abs = hmax_pd(max_abs);
+  dev.max_rel = hmax_pd(max_rel);
+  dev.n_outside += n_outside;
+  dev.n_values += i;
+  compare_scalar<float, load_float_be>(a + 4 * i, b + 4 * i, n - i, abs_eps,
+                                       rel_eps, dev);
+}
+
+__attribute__((target("avx2"))) static void compare_double_avx2(
+    const unsigned char *a, const unsigned char *b, std::size_t n,
+    double abs_eps, double rel_eps, Deviation &dev) {
+  const __m256i bswap = _mm256_setr_epi8(
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+      7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+  const __m256d v_abs = _mm256_set1_pd(abs_eps), v_rel = _mm256_set1_pd(rel_eps);
+  __m256d max_abs = _mm256_set1_pd(dev.max_abs), max_rel = _mm256_set1_pd(dev.max_rel);
+  Long64_t n_outside = 0;
+
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i ra = _mm256_loadu_si256((const __m256i *)(a + 8 * i));
+    __m256i rb = _mm256_loadu_si256((const __m256i *)(b + 8 * i));
+    __m256i eq = _mm256_cmpeq_epi64(ra, rb);
+    if (_mm256_movemask_epi8(eq) == -1) continue;
+
+    compare_lanes(_mm256_castsi256_pd(_mm256_shuffle_epi8(ra, bswap)),
+                  _mm256_castsi256_pd(_mm256_shuffle_epi8(rb, bswap)),
+                  _mm256_castsi256_pd(eq), v_abs, v_rel, max_abs, max_rel,
+                  n_outside);
+  }
+
+  dev.max_abs = hmax_pd(max_abs);
+  dev.max_rel = hmax_pd(max_rel);
+  dev.n_outside += n_outside;
+  dev.n_values += i;
+  compare_scalar<double, load_double_be>(a + 8 * i, b + 8 * i, n - i, abs_eps,
+                                         rel_eps, dev);
+}
+
+#endif
+
+bool numeric_cmp_avx2() {
+#ifdef ROOT_DIFF_AVX2
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+#else
+  return false;
+#endif
+}
+
+void compare_float_be(const unsigned char *a, const unsigned char *b,
+                      std::size_t n, double abs_eps, double rel_eps,
+                      Deviation &dev) {
+#ifdef ROOT_DIFF_AVX2
+  if (numeric_cmp_avx2()) {
+    compare_float_avx2(a, b, n, abs_eps, rel_eps, dev);
+    return;
+  }
+#endif
+  compare_scalar<float, load_float_be>(a, b, n, abs_eps, rel_eps, dev);
+}
+
+void compare_double_be(const unsigned char *a, const unsigned char *b,
+                       std::size_t n, double abs_eps, double rel_eps,
+                       Deviation &dev) {
+#ifdef ROOT_DIFF_AVX2
+  if (numeric_cmp_avx2()) {
+    compare_double_avx2(a, b, n, abs_eps, rel_eps, dev);
+    return;
+  }
+#endif
+  compare_scalar<double, load_double_be>(a, b, n, abs_eps, rel_eps, dev);
+}
+
+}  // namespace rootdiff
@@ -0,0 +1,70 @@
+#ifndef ROOT_DIFF_NUMERIC_CMP
+#define ROOT_DIFF_NUMERIC_CMP
+
+#include <cstddef>
+
+#include "RtypesCore.h"
+
+namespace rootdiff {
+
+/**
+ * Largest differences found between two columns of floating-point values
+ */
+struct Deviation {
+  /// Largest absolute difference
+  double max_abs{0.};
+  /// Largest difference relative to the larger magnitude of the two values
+  double max_rel{0.};
+  /// Number of values compared
+  Long64_t n_values{0};
+  /// Number of values outside of the tolerance, including NaN differences
+  /// which are left out of the maxima
+  Long64_t n_outside{0};
+
+  /**
+   * Add the differences found in another part of the column
+   */
+  void merge(const Deviation &other) {
+    if (other.max_abs > max_abs) max_abs = other.max_abs;
+    if (other.max_rel > max_rel) max_rel = other.max_rel;
+    n_values += other.n_values;
+    n_outside += other.n_outside;
+  }
+};
+
+/**
+ * Are the comparison kernels using AVX2 on this CPU?
+ */
+bool numeric_cmp_avx2();
+
+/**
+ * Compare two arrays of big-endian (i.e. on-disk) floats
+ *
+ * Two values agree if they are bitwise equal or if
+ * |a - b| <= abs_eps + rel_eps * max(|a|, |b|).
+ * Uses AVX2 when the CPU supports it and a loop the compiler can
+ * vectorize otherwise.
+ *
+ * @param[in] a Bytes of the first array
+ * @param[in] b Bytes of the second array
+ * @param[in] n Number of values in each array
+ * @param[in] abs_eps Absolute tolerance
+ * @param[in] rel_eps Relative tolerance
+ * @param[in,out] dev Deviations found so far
+ */
+void compare_float_be(const unsigned char *a, const unsigned char *b,
+                      std::size_t n, double abs_eps, double rel_eps,
+                      Deviation &dev);
+
+/**
+ * Compare two arrays of big-endian (i.e. on-disk) doubles
+ *
+ * Same as compare_float_be for double precision values.
+ */
+void compare_double_be(const unsigned char *a, const unsigned char *b,
+                       std::size_t n, double abs_eps, double rel_eps,
+                       Deviation &dev);
+
+}  // namespace rootdiff
+
+#endif
@@ -1,30 +1,206 @@
-#include "root_obj_comparator.h"
+#include "ObjectComparer.h"
+
+#include "Bytes.h"
+#include "ContentCache.h"
+#include "Hash.h"
+#include "TBranch.h"
+#include "TDirectory.h"
+#include "TLeaf.h"
+#include "TObjArray.h"
+#include "TTree.h"
 
 namespace rootdiff {
 
-static unsigned char *buffer_uncomprs(const ObjectInfo &obj_info, TFile &f) {
-  int obj_len = obj_info.obj_len, key_len = obj_info.key_len,
-      nsize = obj_info.nbytes, comprs_len = nsize - key_len;
+/**
+ * Fields of a TBasket key needed to locate its column of values
+ */
+struct BasketHeader {
+  /// Name of the tree, stored as the title of the key
+  std::string tree_name;
+  /// Name of the branch, stored as the name of the key
+  std::string branch_name;
+  /// Length of the entry data in the key buffer, key included
+  Int_t last;
+};
+
+/**
+ * Read a string of a key header, checking it stays inside of the header
+ */
+static bool read_key_string(char *&cur, const char *end, std::string &str) {
+  if (cur >= end) return false;
+  unsigned char len = (unsigned char)*cur++;
+  if (len == 255 or cur + len > end) return false;
+  str.assign(cur, len);
+  cur += len;
+  return true;
+}
 
-  long offset = obj_info.seek_key + key_len;
+/**
+ * Read the key of a TBasket, which is followed by the basket header
+ */
+static bool read_basket_header(const ObjectInfo &obj_info, RootFile &f,
+                               BasketHeader &basket) {
+  std::vector<char> buf(obj_info.key_len);
+  if (!f.read(buf.data(), obj_info.seek_key, obj_info.key_len)) return false;
+
+  char *cur = buf.data();
+  const char *end = buf.data() + buf.size();
+
+  // nbytes, version, objlen, datime, keylen and cycle of the key
+  Version_t version_key;
+  cur += sizeof(Int_t);
+  frombuf(cur, &version_key);
+  cur += sizeof(Int_t) + sizeof(UInt_t) + 2 * sizeof(Short_t);
+  // seek_key and seek_pdir
+  cur += (version_key > 1000 ? 2 * sizeof(Long64_t) : 2 * sizeof(Int_t));
+
+  std::string class_name;
+  if (!read_key_string(cur, end, class_name) or
+      !read_key_string(cur, end, basket.branch_name) or
+      !read_key_string(cur, end, basket.tree_name)) {
+    return false;
+  }
 
-  unsigned char *uncomprs_buf;
+  // version, buffer size, entry size, number of entries, last, flag
+  Version_t version_basket;
+  Int_t buffer_size, nev_buf_size, nev_buf;
+  if (cur + sizeof(Version_t) + 4 * sizeof(Int_t) > end) return false;
+  frombuf(cur, &version_basket);
+  frombuf(cur, &buffer_size);
+  frombuf(cur, &nev_buf_size);
+  frombuf(cur, &nev_buf);
+  frombuf(cur, &basket.last);
+  return true;
+}
+
+/**
+ * Find the directory whose record starts at the input offset
+ */
+static TDirectory *find_dir(TDirectory *dir, Long64_t seek_dir) {
+  if (dir->GetSeekDir() == seek_dir) return dir;
+
+  TIter next(dir->GetListOfKeys());
+  while (TKey *key = (TKey *)next()) {
+    if (strcmp(key->GetClassName(), ROOT_DIR) != 0) continue;
+    TDirectory *sub = dir->GetDirectory(key->GetName());
+    if (!sub) continue;
+    TDirectory *found = find_dir(sub, seek_dir);
+    if (found) return found;
+  }
 
+  return nullptr;
+}
+
+/**
+ * Read the payload of an object as it is stored in the file
+ */
+static char *buffer_comprs(const ObjectInfo &obj_info, RootFile &f) {
+  int comprs_len = obj_info.nbytes - obj_info.key_len;
   char *buf = new char[comprs_len];
 
-  f.Seek(offset);
-  f.ReadBuffer(buf, comprs_len);
+  f.read(buf, obj_info.seek_key + obj_info.key_len, comprs_len);
+
+  return buf;
+}
+
+/**
+ * Length of the buffer returned by buffer_uncomprs
+ */
+static int uncomprs_len(const ObjectInfo &obj_info) {
+  int comprs_len = obj_info.nbytes - obj_info.key_len;
+  return obj_info.obj_len > comprs_len ? obj_info.obj_len : comprs_len;
+}
+
+/**
+ * Blank out the creation/modification dates and the fUUID of a TDirectory
+ * record starting at offset
+ *
+ * The seek pointers are compared, a directory whose keys moved differs.
+ */
+static void mask_directory(unsigned char *buf, int len, int offset) {
+  if (offset + 2 > len) return;
+  char *cur = (char *)buf + offset;
+  Version_t version;
+  frombuf(cur, &version);
+  int seek_len = version > 1000 ? sizeof(Long64_t) : sizeof(Int_t);
+
+  // version, fDatimeC, fDatimeM, fNbytesKeys, fNbytesName, 3 seeks, fUUID
+  int datime_begin = offset + 2, datime_end = datime_begin + 8;
+  int uuid_begin = datime_end + 8 + 3 * seek_len + 2, uuid_end = uuid_begin + 16;
+  if (uuid_end > len) return;
+
+  memset(buf + datime_begin, 0, datime_end - datime_begin);
+  memset(buf + uuid_begin, 0, uuid_end - uuid_begin);
+}
+
+/**
+ * Blank out the dates of the key headers in a list of keys
+ *
+ * @return false, leaving the buffer untouched, if the buffer does not
+ * parse as a number of keys followed by exactly that many key headers
+ */
+static bool mask_key_list(unsigned char *buf, int len) {
+  if (len < 4) return false;
+  char *cur = (char *)buf;
+  Int_t nkeys;
+  frombuf(cur, &nkeys);
+
+  // nbytes, version, objlen, datime, keylen
+  const int fixed_len = 4 + 2 + 4 + 4 + 2;
+  std::vector<int> datimes;
+  int offset = 4;
+  for (Int_t i = 0; i < nkeys; i++) {
+    if (offset + fixed_len > len) return false;
+    cur = (char *)buf + offset + fixed_len - 2;
+    Short_t key_len;
+    frombuf(cur, &key_len);
+    if (key_len < fixed_len) return false;
+    datimes.push_back(offset + 10);
+    offset += key_len;
+  }
+  if (offset != len) return false;
+
+  for (int datime : datimes) memset(buf + datime, 0, 4);
+  return true;
+}
+
+/**
+ * Blank out the volatile fields of a decompressed payload
+ */
+static void mask_volatile(VolatileFields fields, unsigned char *buf, int len) {
+  switch (fields) {
+    case VolatileFields::Directory:
+      // the keys list of a directory is stored under the directory's class
+      if (!mask_key_list(buf, len)) mask_directory(buf, len, 0);
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Decompress the payload of an object read by buffer_comprs
+ */
+static unsigned char *uncompress(const ObjectInfo &obj_info, char *buf) {
+  int obj_len = obj_info.obj_len, key_len = obj_info.key_len,
+      nsize = obj_info.nbytes, comprs_len = nsize - key_len;
+
+  unsigned char *uncomprs_buf;
 
   if (obj_len > comprs_len) {
     // Object is compressed
     uncomprs_buf = new unsigned char[obj_len];
     int nin, nout = 0, noutot = 0, nbuf;
 
-    while (true) {
+    int nintot = 0;
+
+    // Large objects are split into several compressed blocks
+    while (nintot < comprs_len) {
+      unsigned char *block = (unsigned char *)buf + nintot;
       // Get information of compressed buffer
-      R__unzip_header(&nin, (unsigned char *)buf, &nbuf);
+      R__unzip_header(&nin, block, &nbuf);
       // Uncompress the buffer
-      R__unzip(&nin, (unsigned char *)buf, &nbuf, uncomprs_buf, &nout);
+      R__unzip(&nin, block, &nbuf, uncomprs_buf + noutot, &nout);
       if (!nout) {
         break;
       }
@@ -32,8 +208,7 @@ static unsigned char *buffer_uncomprs(const ObjectInfo &obj_info, TFile &f) {
       if (noutot >= obj_len) {
         break;
       }
-      buf += nin;
-      uncomprs_buf += nout;
+      nintot += nin;
     }
 
   } else {
@@ -42,17 +217,40 @@ static unsigned char *buffer_uncomprs(const ObjectInfo &obj_info, TFile &f) {
     memcpy(uncomprs_buf, buf, comprs_len);
   }
 
-  delete[] buf;
+  return uncomprs_buf;
+}
 
+static unsigned char *buffer_uncomprs(const ObjectInfo &obj_info, RootFile &f) {
+  char *buf = buffer_comprs(obj_info, f);
+  unsigned char *uncomprs_buf = uncompress(obj_info, buf);
+  delete[] buf;
   return uncomprs_buf;
 }
 
+/**
+ * Fingerprint of a payload read by buffer_comprs
+ */
+static Fingerprint fingerprint(const ObjectInfo &obj_info, const char *buf) {
+  int comprs_len = obj_info.nbytes - obj_info.key_len;
+  return {comprs_len, hash_bytes(buf, comprs_len)};
+}
+
 /*
  * If two objects have same object length, number of cycles, class name and
  * object name, then they are logically equal to each other.
  */
 
 bool ObjectComparer::logic_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &obj_info_2) const {
+  // Values that differ within the tolerance compress to a different
+  // length, so baskets are paired by branch and uncompressed length
+  if (tolerant_ and obj_info_1.class_name == "TBasket" and
+      obj_info_2.class_name == "TBasket") {
+    return obj_info_1.seek_pdir == obj_info_2.seek_pdir and
+           obj_info_1.obj_name == obj_info_2.obj_name and
+           obj_info_1.cycle == obj_info_2.cycle and
+           obj_info_1.obj_len == obj_info_2.obj_len;
+  }
+
   if ((obj_info_1.nbytes) != (obj_info_2.nbytes)) {
     return false;
   }
@@ -85,32 +283,207 @@ bool ObjectComparer::exact_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &o
   return true;
 }
 
-bool ObjectComparer::compressed_cmp(const ObjectInfo &obj_info_1, TFile &f_1, const ObjectInfo &obj_info_2, TFile &f_2) const {
+/*
+ * The leaf types of a branch live in the TTree object of its directory,
+ * so the tree is read once per file, directory and branch.
+ * 'F' means every leaf is Float_t, 'D' every leaf is Double_t and 0 any
+ * other combination, including the packed Float16_t and Double32_t.
+ */
+
+char ObjectComparer::column_type(RootFile &f, Long64_t seek_pdir,
+                                 const std::string &tree,
+                                 const std::string &branch) const {
+  std::string id = f.name() + ":" + std::to_string(seek_pdir) +
+                   ":" + tree + "/" + branch;
+  {
+    std::lock_guard<std::mutex> lock(column_types_->mtx);
+    auto it = column_types_->types.find(id);
+    if (it != column_types_->types.end()) return it->second;
+  }
+
+  char type = 0;
+  TDirectory *dir = find_dir(&f.tfile(), seek_pdir);
+  TTree *t = dir ? dynamic_cast<TTree *>(dir->Get(tree.c_str())) : nullptr;
+  TBranch *br = t ? t->GetBranch(branch.c_str()) : nullptr;
+  if (br) {
+    TObjArray *leaves = br->GetListOfLeaves();
+    for (int i = 0; i < leaves->GetEntriesFast(); i++) {
+      std::string leaf_type = ((TLeaf *)leaves->At(i))->GetTypeName();
+      char this_type = 0;
+      if (leaf_type == "Float_t") this_type = 'F';
+      if (leaf_type == "Double_t") this_type = 'D';
+      if (i > 0 and this_type != type) this_type = 0;
+      type = this_type;
+      if (!type) break;
+    }
+  }
+
+  if (debug_) {
+    std::cout << "Column type of " << tree << "/" << branch << " is '"
+              << (type ? type : '0') << "'" << std::endl;
+  }
+
+  std::lock_guard<std::mutex> lock(column_types_->mtx);
+  column_types_->types[id] = type;
+  return type;
+}
+
+bool ObjectComparer::tolerance_cmp(const ObjectInfo &obj_info_1, RootFile &f1,
+                                   const ObjectInfo &obj_info_2, RootFile &f2,
+                                   std::string &branch, Deviation &dev) const {
+  BasketHeader basket_1, basket_2;
+  if (!read_basket_header(obj_info_1, f1, basket_1) or
+      !read_basket_header(obj_info_2, f2, basket_2)) {
+    return false;
+  }
+
+  if (basket_1.last != basket_2.last or
+      obj_info_1.obj_len != obj_info_2.obj_len) {
+    return false;
+  }
+
+  char type = column_type(f1, obj_info_1.seek_pdir, basket_1.tree_name,
+                          basket_1.branch_name);
+  if (!type) return false;
+
+  if (debug_) { std::cout << "unzip the buffer" << std::endl; }
+  unsigned char *uncomprs_buf_1 = buffer_uncomprs(obj_info_1, f1);
+
+  if (debug_) { std::cout << "unzip the buffer" << std::endl; }
+  unsigned char *uncomprs_buf_2 = buffer_uncomprs(obj_info_2, f2);
+
+  // The entry data fills the buffer up to fLast, the entry offsets of
+  // variable size branches follow it
+  int obj_len = obj_info_1.obj_len;
+  int data_len = basket_1.last - obj_info_1.key_len;
+  if (data_len < 0 or data_len > obj_len) data_len = 0;
+
+  branch = basket_1.tree_name + "/" + basket_1.branch_name;
+  int col_len;
+  if (type == 'F') {
+    col_len = data_len - data_len % sizeof(Float_t);
+    compare_float_be(uncomprs_buf_1, uncomprs_buf_2, col_len / sizeof(Float_t),
+                     abs_eps_, rel_eps_, dev);
+  } else {
+    col_len = data_len - data_len % sizeof(Double_t);
+    compare_double_be(uncomprs_buf_1, uncomprs_buf_2, col_len / sizeof(Double_t),
+                      abs_eps_, rel_eps_, dev);
+  }
+
+  int rc = memcmp(uncomprs_buf_1 + col_len, uncomprs_buf_2 + col_len,
+                  obj_len - col_len);
+
+  delete[] uncomprs_buf_1;
+  delete[] uncomprs_buf_2;
+
+  return (rc == 0 and dev.n_outside == 0);
+}
+
+uint64_t ObjectComparer::payload_hash(const ObjectInfo &obj_info,
+                                      RootFile &f) const {
+  char *buf = buffer_comprs(obj_info, f);
+  uint64_t hash = payload_hash(obj_info, buf);
+  delete[] buf;
+  return hash;
+}
+
+uint64_t ObjectComparer::payload_hash(const ObjectInfo &obj_info,
+                                      char *payload) const {
+  if (compare_compressed_) {
+    return hash_bytes(payload, obj_info.nbytes - obj_info.key_len);
+  }
+
+  // A payload seen before is not decompressed again
+  uint64_t hash;
+  ContentCache &cache = ContentCache::instance();
+  Fingerprint fp{0, 0};
+  if (cache.enabled()) fp = fingerprint(obj_info, payload);
+  if (!cache.uncomprs_hash(fp, hash)) {
+    unsigned char *uncomprs_buf = uncompress(obj_info, payload);
+    hash = hash_bytes(uncomprs_buf, uncomprs_len(obj_info));
+    delete[] uncomprs_buf;
+    cache.set_uncomprs_hash(fp, hash);
+  }
+  return hash;
+}
+
+/*
+ * Objects with the HEADER strategy are equal if their keys describe
+ * payloads of the same length, their payloads are never read.
+ */
+
+bool ObjectComparer::header_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &obj_info_2) const {
+  if (obj_info_1.obj_len != obj_info_2.obj_len) {
+    return false;
+  }
+
+  if (obj_info_1.key_len != obj_info_2.key_len) {
+    return false;
+  }
+
+  return true;
+}
+
+bool ObjectComparer::hash_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const {
   if (debug_) {
     std::cout << 
-        "Compare the compressed buffer of '"
+        "Compare the hash of the buffer of '"
+        << obj_info_1.class_name
+        << "' object in file 1 and '"
+        << obj_info_2.class_name
+        << "' object in file 2" << std::endl;
+  }
+
+  return payload_hash(obj_info_1, f1) == payload_hash(obj_info_2, f2);
+}
+
+bool ObjectComparer::masked_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const {
+  if (debug_) {
+    std::cout << 
+        "Compare the masked buffer of '"
         << obj_info_1.class_name
         << "' object in file 1 and '"
         << obj_info_2.class_name
         << "' object in file 2" << std::endl;
   }
 
-  int nsize_1 = obj_info_1.nbytes, nsize_2 = obj_info_2.nbytes;
+  if (obj_info_1.obj_len != obj_info_2.obj_len) {
+    return false;
+  }
+
+  unsigned char *uncomprs_buf_1 = buffer_uncomprs(obj_info_1, f1);
+  unsigned char *uncomprs_buf_2 = buffer_uncomprs(obj_info_2, f2);
+  int len = uncomprs_len(obj_info_1);
+
+  VolatileFields fields = strategies_->volatile_fields(obj_info_1.class_id);
+  mask_volatile(fields, uncomprs_buf_1, len);
+  mask_volatile(fields, uncomprs_buf_2, len);
 
-  int k_len_1 = obj_info_1.key_len, k_len_2 = obj_info_2.key_len;
+  int rc = memcmp(uncomprs_buf_1, uncomprs_buf_2, len);
 
-  int cmprs_len_1 = nsize_1 - k_len_1, cmprs_len_2 = nsize_2 - k_len_2;
+  delete[] uncomprs_buf_1;
+  delete[] uncomprs_buf_2;
 
-  long offset_1 = obj_info_1.seek_key + k_len_1,
-       offset_2 = obj_info_2.seek_key + k_len_2;
+  return (rc == 0 ? true : false);
+}
 
-  char *buf_1 = new char[cmprs_len_1], *buf_2 = new char[cmprs_len_2];
+bool ObjectComparer::compressed_cmp(const ObjectInfo &obj_info_1, RootFile &f_1, const ObjectInfo &obj_info_2, RootFile &f_2) const {
+  if (debug_) {
+    std::cout << 
+        "Compare the compressed buffer of '"
+        << obj_info_1.class_name
+        << "' object in file 1 and '"
+        << obj_info_2.class_name
+        << "' object in file 2" << std::endl;
+  }
 
-  f_1.Seek(offset_1);
-  f_1.ReadBuffer(buf_1, cmprs_len_1);
+  int cmprs_len_1 = obj_info_1.nbytes - obj_info_1.key_len;
+  if (obj_info_2.nbytes - obj_info_2.key_len != cmprs_len_1) {
+    return false;
+  }
 
-  f_2.Seek(offset_2);
-  f_2.ReadBuffer(buf_2, cmprs_len_2);
+  char *buf_1 = buffer_comprs(obj_info_1, f_1),
+       *buf_2 = buffer_comprs(obj_info_2, f_2);
 
   int rc = memcmp((unsigned char *)buf_1, (unsigned char *)buf_2, cmprs_len_1);
 
@@ -120,7 +493,7 @@ bool ObjectComparer::compressed_cmp(const ObjectInfo &obj_info_1, TFile &f_1, co
   return (rc == 0 ? true : false);
 }
 
-bool ObjectComparer::uncompressed_cmp(const ObjectInfo &obj_info_1, TFile &f1, const ObjectInfo &obj_info_2, TFile &f2) const {
+bool ObjectComparer::uncompressed_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const {
   if (debug_) {
     std::cout << 
         "Compare the uncompressed buffer of '"
@@ -130,20 +503,60 @@ bool ObjectComparer::uncompressed_cmp(const ObjectInfo &obj_info_1, TFile &f1, c
         << "' object in file 2" << std::endl;
   }
 
-  if (debug_) { std::cout << "unzip the buffer" << std::endl; }
-  unsigned char *uncomprs_buf_1 = buffer_uncomprs(obj_info_1, f1);
-  
-  if (debug_) { std::cout << "unzip the buffer" << std::endl; }
-  unsigned char *uncomprs_buf_2 = buffer_uncomprs(obj_info_2, f2);
+  char *buf_1 = buffer_comprs(obj_info_1, f1),
+       *buf_2 = buffer_comprs(obj_info_2, f2);
+  int cmprs_len_1 = obj_info_1.nbytes - obj_info_1.key_len,
+      cmprs_len_2 = obj_info_2.nbytes - obj_info_2.key_len;
 
-  int obj_len = obj_info_1.obj_len;
+  // Payloads stored with the same bytes decompress to the same bytes
+  if (cmprs_len_1 == cmprs_len_2 and memcmp(buf_1, buf_2, cmprs_len_1) == 0) {
+    delete[] buf_1;
+    delete[] buf_2;
+    return true;
+  }
 
-  int rc = memcmp(uncomprs_buf_1, uncomprs_buf_2, obj_len);
+  // Payloads seen before are neither decompressed nor compared again
+  ContentCache &cache = ContentCache::instance();
+  Fingerprint fp_1{0, 0}, fp_2{0, 0};
+  if (cache.enabled()) {
+    fp_1 = fingerprint(obj_info_1, buf_1);
+    fp_2 = fingerprint(obj_info_2, buf_2);
+  }
 
-  delete[] uncomprs_buf_1;
-  delete[] uncomprs_buf_2;
+  bool equal;
+  uint64_t hash_1, hash_2;
+  if (cache.verdict(fp_1, fp_2, equal)) {
+    if (debug_) { std::cout << "verdict found in the content cache" << std::endl; }
+  } else if (cache.uncomprs_hash(fp_1, hash_1) and
+             cache.uncomprs_hash(fp_2, hash_2)) {
+    if (debug_) { std::cout << "hashes found in the content cache" << std::endl; }
+    equal = hash_1 == hash_2;
+    cache.set_verdict(fp_1, fp_2, equal);
+  } else {
+    if (debug_) { std::cout << "unzip the buffer" << std::endl; }
+    unsigned char *uncomprs_buf_1 = uncompress(obj_info_1, buf_1);
 
-  return (rc == 0 ? true : false);
+    if (debug_) { std::cout << "unzip the buffer" << std::endl; }
+    unsigned char *uncomprs_buf_2 = uncompress(obj_info_2, buf_2);
+
+    int obj_len = obj_info_1.obj_len;
+
+    equal = memcmp(uncomprs_buf_1, uncomprs_buf_2, obj_len) == 0;
+
+    if (cache.enabled()) {
+      cache.set_uncomprs_hash(fp_1, hash_bytes(uncomprs_buf_1, uncomprs_len(obj_info_1)));
+      cache.set_uncomprs_hash(fp_2, hash_bytes(uncomprs_buf_2, uncomprs_len(obj_info_2)));
+      cache.set_verdict(fp_1, fp_2, equal);
+    }
+
+    delete[] uncomprs_buf_1;
+    delete[] uncomprs_buf_2;
+  }
+
+  delete[] buf_1;
+  delete[] buf_2;
+
+  return equal;
 }
 
 }  // namespace rootdiff
@@ -1,6 +1,7 @@
 #ifndef __ROOT_OBJ_COMP_H__
 #define __ROOT_OBJ_COMP_H__
 
+#include <cstdint>
 #include <iostream>
 
 #include "RZip.h"
@@ -11,8 +12,15 @@
 #include "TKey.h"
 #include "TObject.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 
+#include "NumericCmp.h"
+#include "RootFile.h"
+#include "StrategyTable.h"
+
 #define ROOT_DIR "TDirectoryFile"
 
 namespace rootdiff {
@@ -39,6 +47,8 @@ struct ObjectInfo {
   Long64_t seek_key;
   /// Key to look for this object's directory
   Long64_t seek_pdir;
+  /// Id of the class of this object in the StrategyTable
+  Int_t class_id{0};
   /// Name of the class of this object
   std::string class_name;
   /// Name of the object
@@ -47,24 +57,91 @@ struct ObjectInfo {
 
 class ObjectComparer {
  public:
-  ObjectComparer(bool debug, bool comp_compressed) : 
-    debug_(debug), compare_compressed_(comp_compressed) {}
+  ObjectComparer(bool debug, bool comp_compressed,
+                 std::shared_ptr<const StrategyTable> strategies =
+                     std::make_shared<StrategyTable>()) : 
+    debug_(debug), compare_compressed_(comp_compressed),
+    strategies_(strategies),
+    column_types_(std::make_shared<ColumnTypeCache>()) {}
+
+  /**
+   * Accept float/double basket contents that differ within the tolerance
+   * |a - b| <= abs_eps + rel_eps * max(|a|, |b|)
+   */
+  void set_tolerance(double abs_eps, double rel_eps) {
+    tolerant_ = true;
+    abs_eps_ = abs_eps;
+    rel_eps_ = rel_eps;
+  }
+
+  /// was a tolerance set?
+  bool tolerant() const { return tolerant_; }
+
+  /**
+   * Compare the decompressed contents of two TBasket objects value by value
+   *
+   * Only baskets of branches whose leaves are all Float_t or all Double_t
+   * can be compared this way, for other baskets branch is left empty.
+   *
+   * @param[out] branch Name of the branch as tree/branch
+   * @param[out] dev Deviations between the two baskets
+   * @return true if every value is within the tolerance and the rest of
+   * the basket is byte-level equal
+   */
+  bool tolerance_cmp(const ObjectInfo &obj_info_1, RootFile &f1,
+                     const ObjectInfo &obj_info_2, RootFile &f2,
+                     std::string &branch, Deviation &dev) const;
+
+  /**
+   * Hash of the payload of an object, as stored in the file when comparing
+   * compressed buffers and after decompression otherwise
+   */
+  uint64_t payload_hash(const ObjectInfo &obj_info, RootFile &f) const;
+
+  /**
+   * Hash of a payload already read, the nbytes - key_len bytes that follow
+   * the key of the object
+   */
+  uint64_t payload_hash(const ObjectInfo &obj_info, char *payload) const;
+
   bool logic_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &obj_info_2) const;
   bool exact_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &obj_info_2) const;
-  bool strict_cmp(const ObjectInfo &obj_info_1, TFile &f1, const ObjectInfo &obj_info_2, TFile &f2) const {
-    // Since TDirectoryFile class has fUUID attribute,
-    // we could not compare two TDirectoryFile objects
-    if (obj_info_1.class_name == ROOT_DIR or obj_info_2.class_name == ROOT_DIR) return true;
+  bool strict_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const {
+    // Dispatch on the class id, e.g. TDirectoryFile objects are skipped
+    // by default since their fUUID attribute differs in every file
+    switch (strategies_->strategy(obj_info_1.class_id)) {
+      case Strategy::Skip:   return true;
+      case Strategy::Header: return header_cmp(obj_info_1,obj_info_2);
+      case Strategy::Hash:   return hash_cmp(obj_info_1,f1,obj_info_2,f2);
+      case Strategy::Mask:   return masked_cmp(obj_info_1,f1,obj_info_2,f2);
+      default: break;
+    }
 
     if (compare_compressed_) { return compressed_cmp(obj_info_1,f1,obj_info_2,f2); }
     else                     { return uncompressed_cmp(obj_info_1,f1,obj_info_2,f2); }
   }
  private:
-  bool compressed_cmp(const ObjectInfo &obj_info_1, TFile &f1, const ObjectInfo &obj_info_2, TFile &f2) const;
-  bool uncompressed_cmp(const ObjectInfo &obj_info_1, TFile &f1, const ObjectInfo &obj_info_2, TFile &f2) const;
+  bool header_cmp(const ObjectInfo &obj_info_1, const ObjectInfo &obj_info_2) const;
+  bool hash_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const;
+  bool masked_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const;
+  bool compressed_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const;
+  bool uncompressed_cmp(const ObjectInfo &obj_info_1, RootFile &f1, const ObjectInfo &obj_info_2, RootFile &f2) const;
+  char column_type(RootFile &f, Long64_t seek_pdir, const std::string &tree,
+                   const std::string &branch) const;
  private:
+  /// leaf type of the branches looked up so far, shared between copies
+  struct ColumnTypeCache {
+    std::mutex mtx;
+    std::map<std::string, char> types;
+  };
+
   bool compare_compressed_;
   bool debug_;
+  std::shared_ptr<const StrategyTable> strategies_;
+  bool tolerant_{false};
+  double abs_eps_{0.};
+  double rel_eps_{0.};
+  std::shared_ptr<ColumnTypeCache> column_types_;
 };
 
 }  // namespace rootdiff
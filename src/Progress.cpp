@@ -0,0 +1,140 @@
+#include "Progress.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+namespace rootdiff {
+
+/**
+ * Quote a string for JSON
+ */
+static std::string json_string(const std::string &str) {
+  std::string ret = "\"";
+  for (unsigned char c : str) {
+    if (c == '"' or c == '\\') {
+      ret += '\\';
+      ret += c;
+    } else if (c < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      ret += esc;
+    } else {
+      ret += c;
+    }
+  }
+  return ret + "\"";
+}
+
+Progress::Progress(int fd) : fd_(fd) {
+  reporter_ = std::thread([this] { run(); });
+}
+
+Progress::~Progress() {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (reporter_.joinable()) reporter_.join();
+}
+
+ProgressFile *Progress::add_file(const std::string &name, Long64_t size) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  files_.emplace_back();
+  files_.back().name = name;
+  files_.back().size = size;
+  return &files_.back();
+}
+
+void Progress::finish_file(ProgressFile *file) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (auto it = files_.begin(); it != files_.end(); ++it) {
+    if (&*it != file) continue;
+    bytes_done_ += it->scanned.load(std::memory_order_relaxed);
+    files_.erase(it);
+    return;
+  }
+}
+
+void Progress::lower_level(AgreeLevel al) {
+  int cur = level_.load(std::memory_order_relaxed);
+  while (al < cur and !level_.compare_exchange_weak(cur, al)) {
+  }
+}
+
+void Progress::difference(const std::string &what) {
+  std::lock_guard<std::mutex> lock(mtx_);
+  if (has_difference_) return;
+  first_difference_ = what;
+  has_difference_ = true;
+}
+
+void Progress::finish(AgreeLevel al) {
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (stop_) return;
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (reporter_.joinable()) reporter_.join();
+
+  level_ = al;
+  report(true);
+}
+
+void Progress::run() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  while (!stop_) {
+    cv_.wait_for(lock, std::chrono::seconds(PROGRESS_INTERVAL_SECONDS));
+    if (stop_) break;
+    lock.unlock();
+    report(false);
+    lock.lock();
+  }
+}
+
+void Progress::report(bool done) {
+  std::ostringstream line;
+  line << "{\"elapsed\":" << tmr_.elapsed() << ",\"files\":[";
+
+  Long64_t bytes_scanned;
+  std::string first_difference;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    bytes_scanned = bytes_done_;
+    bool first = true;
+    for (auto const &file : files_) {
+      Long64_t size = file.size.load(std::memory_order_relaxed);
+      Long64_t scanned = file.scanned.load(std::memory_order_relaxed);
+      bytes_scanned += scanned;
+      if (scanned == 0 or scanned == size) continue;
+      line << (first ? "" : ",") << "{\"name\":" << json_string(file.name)
+           << ",\"scanned\":" << scanned << ",\"size\":" << size << "}";
+      first = false;
+    }
+    if (has_difference_) first_difference = json_string(first_difference_);
+  }
+
+  line << "],\"bytes_scanned\":" << bytes_scanned
+       << ",\"pairs_compared\":" << pairs_compared_.load()
+       << ",\"pairs_total\":" << pairs_total_.load() << ",\"level\":\""
+       << agree_level_name((AgreeLevel)level_.load()) << "\""
+       << ",\"first_difference\":"
+       << (first_difference.empty() ? "null" : first_difference)
+       << ",\"done\":" << (done ? "true" : "false") << "}\n";
+
+  std::string str = line.str();
+  const char *cur = str.c_str();
+  std::size_t left = str.size();
+  while (left > 0) {
+    ssize_t n = write(fd_, cur, left);
+    if (n <= 0) break;
+    cur += n;
+    left -= n;
+  }
+}
+
+}  // namespace rootdiff
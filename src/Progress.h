@@ -0,0 +1,161 @@
+#ifndef ROOT_DIFF_PROGRESS
+#define ROOT_DIFF_PROGRESS
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "FileComparer.h"
+
+/**
+ * Seconds between two progress updates
+ */
+#define PROGRESS_INTERVAL_SECONDS 1
+
+/**
+ * Number of records or pairs a thread counts on its own before adding
+ * them to the shared counters
+ */
+#define PROGRESS_BATCH 64
+
+namespace rootdiff {
+
+/**
+ * Scan progress of one file
+ */
+struct ProgressFile {
+  std::string name;
+  /// Bytes to scan, grows with a file being followed
+  std::atomic<Long64_t> size{0};
+  /// Bytes of the records scanned so far
+  std::atomic<Long64_t> scanned{0};
+};
+
+/**
+ * Count locally and add to a shared counter every PROGRESS_BATCH calls
+ *
+ * Keeps the atomic operations off the per-record path. Does nothing if
+ * there is no shared counter.
+ */
+class BatchedCounter {
+ public:
+  BatchedCounter(std::atomic<Long64_t> *target) : target_(target) {}
+  ~BatchedCounter() { flush(); }
+
+  void add(Long64_t n) {
+    if (!target_) return;
+    local_ += n;
+    if (++calls_ == PROGRESS_BATCH) flush();
+  }
+
+  void flush() {
+    if (target_ and local_) target_->fetch_add(local_, std::memory_order_relaxed);
+    local_ = 0;
+    calls_ = 0;
+  }
+
+ private:
+  std::atomic<Long64_t> *target_;
+  Long64_t local_{0};
+  int calls_{0};
+};
+
+/**
+ * Periodic machine-readable progress of a run
+ *
+ * A reporter thread writes one JSON object per line to a file descriptor
+ * every PROGRESS_INTERVAL_SECONDS:
+ *
+ *     {"elapsed":1.0,"files":[{"name":"a.root","scanned":1024,"size":4096}],
+ *      "bytes_scanned":1024,"pairs_compared":0,"pairs_total":0,
+ *      "level":"EXACT","first_difference":null,"done":false}
+ *
+ * "files" lists the files whose scan has started but not finished.
+ * "level" is the best agreement level the run can still reach and
+ * "first_difference" describes the first difference found. The last line
+ * has "done" set and the final level.
+ */
+class Progress {
+ public:
+  /**
+   * Constructor
+   * Start the reporter thread writing to the input file descriptor.
+   */
+  Progress(int fd);
+
+  /**
+   * Destructor
+   * Stop the reporter thread.
+   */
+  ~Progress();
+
+  /**
+   * Start tracking the scan of a file
+   *
+   * @return the counters of the file, valid until finish_file is called
+   */
+  ProgressFile *add_file(const std::string &name, Long64_t size);
+
+  /**
+   * Stop tracking the scan of a file, its scanned bytes are kept in the
+   * total
+   */
+  void finish_file(ProgressFile *file);
+
+  /// count the object pairs found by matching
+  void add_pairs(Long64_t n) {
+    pairs_total_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  /// counter of the object pairs whose content was compared
+  std::atomic<Long64_t> *pairs_compared() { return &pairs_compared_; }
+
+  /**
+   * Lower the provisional agreement level
+   */
+  void lower_level(AgreeLevel al);
+
+  /**
+   * Record a difference, only the first one is reported
+   */
+  void difference(const std::string &what);
+
+  /// has a difference been recorded already?
+  bool has_difference() const {
+    return has_difference_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * Write the last update with the final agreement level and stop the
+   * reporter thread
+   */
+  void finish(AgreeLevel al);
+
+ private:
+  void run();
+  void report(bool done);
+
+ private:
+  int fd_;
+  Timer tmr_;
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  bool stop_{false};
+  std::thread reporter_;
+  /// files being scanned, a list so that the counters never move
+  std::list<ProgressFile> files_;
+  /// bytes scanned of the files no longer tracked
+  Long64_t bytes_done_{0};
+  std::atomic<Long64_t> pairs_total_{0};
+  std::atomic<Long64_t> pairs_compared_{0};
+  std::atomic<int> level_{AgreeLevel::Exact_eq};
+  std::atomic<bool> has_difference_{false};
+  std::string first_difference_;
+};
+
+}  // namespace rootdiff
+
+#endif
@@ -0,0 +1,103 @@
+#include "RootFile.h"
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "Bytes.h"
+#include "FileComparer.h"
+
+namespace rootdiff {
+
+/**
+ * Read the offsets of the file header and fSeekKeys of the top directory
+ *
+ * @return false if the header is not on disk yet or the file does not
+ * start with the "root" magic
+ */
+static bool read_file_header(IOBackend &io, FileHeader &header) {
+  char buf[HEADER_LEN] = {0};
+  if (!io.read(buf, 0, HEADER_LEN)) return false;
+  if (memcmp(buf, "root", 4) != 0) return false;
+
+  char *cur = buf + 4;
+  Int_t version, begin, nbytes_free, nfree, nbytes_name;
+  char units;
+  frombuf(cur, &version);
+  frombuf(cur, &begin);
+  header.begin = begin;
+  bool large = version >= 1000000;
+  if (large) {
+    frombuf(cur, &header.end);
+    frombuf(cur, &header.seek_free);
+  } else {
+    Int_t end, seek_free;
+    frombuf(cur, &end);
+    frombuf(cur, &seek_free);
+    header.end = end;
+    header.seek_free = seek_free;
+  }
+  frombuf(cur, &nbytes_free);
+  frombuf(cur, &nfree);
+  frombuf(cur, &nbytes_name);
+  frombuf(cur, &units);
+  frombuf(cur, &header.compress);
+  if (large) {
+    frombuf(cur, &header.seek_info);
+  } else {
+    Int_t seek_info;
+    frombuf(cur, &seek_info);
+    header.seek_info = seek_info;
+  }
+
+  // version, fDatimeC, fDatimeM, fNbytesKeys, fNbytesName, fSeekDir,
+  // fSeekParent and fSeekKeys of the top directory
+  char dir[2 + 4 * sizeof(Int_t) + 3 * sizeof(Long64_t)] = {0};
+  if (!io.read(dir, begin + nbytes_name, sizeof(dir))) return false;
+  cur = dir;
+  Version_t dir_version;
+  frombuf(cur, &dir_version);
+  cur += 4 * sizeof(Int_t);
+  if (dir_version > 1000) {
+    cur += 2 * sizeof(Long64_t);
+    frombuf(cur, &header.seek_keys);
+  } else {
+    Int_t seek_keys;
+    cur += 2 * sizeof(Int_t);
+    frombuf(cur, &seek_keys);
+    header.seek_keys = seek_keys;
+  }
+  return true;
+}
+
+RootFile::RootFile(const std::string &fn, std::unique_ptr<IOBackend> io,
+                   bool growing)
+    : fn_(fn), io_(std::move(io)) {
+  if (reload_header()) return;
+
+  // A file being written may not hold its top directory yet
+  char magic[4];
+  if (!growing or !io_->read(magic, 0, sizeof(magic)) or
+      memcmp(magic, "root", sizeof(magic)) != 0) {
+    std::cerr << fn << " is not a ROOT file" << std::endl;
+    throw std::exception();
+  }
+}
+
+RootFile::~RootFile() {}
+
+bool RootFile::reload_header() {
+  io_->drop_cache();
+  FileHeader header;
+  if (!read_file_header(*io_, header)) return false;
+  header_ = header;
+  return true;
+}
+
+TFile &RootFile::tfile() {
+  if (TFile *f = io_->tfile()) return *f;
+  if (!tfile_) tfile_.reset(new TFile(fn_.c_str()));
+  return *tfile_;
+}
+
+}  // namespace rootdiff
@@ -0,0 +1,95 @@
+#ifndef ROOT_DIFF_ROOT_FILE
+#define ROOT_DIFF_ROOT_FILE
+
+#include <memory>
+#include <string>
+
+#include "IOBackend.h"
+#include "RtypesCore.h"
+#include "TFile.h"
+
+namespace rootdiff {
+
+/**
+ * Offsets of the file header and of the top directory
+ */
+struct FileHeader {
+  /// Offset of the first record
+  Long64_t begin{0};
+  /// Offset of the first unused byte
+  Long64_t end{0};
+  /// Offset of the record of the free segments
+  Long64_t seek_free{0};
+  /// Offset of the record of the streamer infos
+  Long64_t seek_info{0};
+  /// Offset of the keys list of the top directory, 0 until the file is closed
+  Long64_t seek_keys{0};
+  /// Compression algorithm and level of the file (fCompress)
+  Int_t compress{0};
+};
+
+/**
+ * A root file read through an I/O backend
+ *
+ * The records are read with the backend, ROOT is only asked for objects
+ * that have to be streamed (e.g. the TTree of a basket).
+ */
+class RootFile {
+ public:
+  /**
+   * Constructor
+   * Read the header of the file with the input backend.
+   *
+   * Throws if the file does not have a valid header.
+   *
+   * @param[in] growing Is the file still being written? Its header is
+   * then only required to start with the "root" magic.
+   */
+  RootFile(const std::string &fn, std::unique_ptr<IOBackend> io,
+           bool growing = false);
+  ~RootFile();
+  RootFile(RootFile &&) = default;
+
+  /// name of the file
+  const std::string &name() const { return fn_; }
+
+  /// header read when the file was opened or last reloaded
+  const FileHeader &header() const { return header_; }
+
+  /**
+   * Read len bytes at offset into buf
+   *
+   * @return false if the bytes could not all be read
+   */
+  bool read(char *buf, Long64_t offset, Long64_t len) {
+    return io_->read(buf, offset, len);
+  }
+
+  /// backend reading the file
+  IOBackend &io() { return *io_; }
+
+  /**
+   * Read the header again, for files that are still being written
+   *
+   * @return false if the header is not on disk yet
+   */
+  bool reload_header();
+
+  /**
+   * The file opened with ROOT
+   *
+   * The backend's own TFile when it reads through ROOT, otherwise the
+   * file is opened on the first call.
+   */
+  TFile &tfile();
+
+ private:
+  std::string fn_;
+  std::unique_ptr<IOBackend> io_;
+  FileHeader header_;
+  std::unique_ptr<TFile> tfile_;
+};
+
+}  // namespace rootdiff
+
+#endif
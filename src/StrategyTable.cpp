@@ -0,0 +1,71 @@
+#include "StrategyTable.h"
+
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace rootdiff {
+
+StrategyTable::StrategyTable() {
+  // id 0 is every class without a strategy of its own
+  strategies_.push_back(Strategy::Full);
+  fields_.push_back(VolatileFields::None);
+  set("TDirectoryFile", Strategy::Skip);
+}
+
+void StrategyTable::set(const std::string &class_name, Strategy strategy) {
+  auto it = ids_.find(class_name);
+  if (it != ids_.end()) {
+    strategies_[it->second] = strategy;
+    return;
+  }
+
+  VolatileFields fields = VolatileFields::None;
+  if (class_name == "TDirectoryFile" or class_name == "TDirectory") {
+    fields = VolatileFields::Directory;
+  }
+
+  ids_[class_name] = strategies_.size();
+  strategies_.push_back(strategy);
+  fields_.push_back(fields);
+}
+
+void StrategyTable::load(const std::string &fn) {
+  std::ifstream cfg(fn);
+  if (!cfg) {
+    std::cerr << "Cannot open strategy file " << fn << std::endl;
+    throw std::exception();
+  }
+
+  std::string line;
+  int line_num = 0;
+  while (getline(cfg, line)) {
+    line_num++;
+    std::istringstream fields(line);
+    std::string class_name, name;
+    if (!(fields >> class_name) or class_name[0] == '#') continue;
+    fields >> name;
+
+    Strategy strategy;
+    if (name == "full") {
+      strategy = Strategy::Full;
+    } else if (name == "skip") {
+      strategy = Strategy::Skip;
+    } else if (name == "header") {
+      strategy = Strategy::Header;
+    } else if (name == "hash") {
+      strategy = Strategy::Hash;
+    } else if (name == "mask") {
+      strategy = Strategy::Mask;
+    } else {
+      std::cerr << "Unrecognized strategy '" << name << "' for class "
+                << class_name << " at line " << line_num << " of " << fn
+                << std::endl;
+      throw std::exception();
+    }
+    set(class_name, strategy);
+  }
+}
+
+}  // namespace rootdiff
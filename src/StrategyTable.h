@@ -0,0 +1,85 @@
+#ifndef ROOT_DIFF_STRATEGY_TABLE
+#define ROOT_DIFF_STRATEGY_TABLE
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "RtypesCore.h"
+
+namespace rootdiff {
+
+/**
+ * How the content of two structurally equal objects is compared
+ * 1. FULL - compare every byte of the payload (CC or UC)
+ * 2. SKIP - do not compare the payload, the objects are always equal
+ * 3. HEADER - compare the lengths in the key headers, no payload I/O
+ * 4. HASH - compare a hash of each payload (CC or UC)
+ * 5. MASK - decompress and compare with the volatile fields (fUUID and
+ *    fDatimeC/M of directories, the dates in lists of keys) blanked out
+ */
+enum class Strategy { Full, Skip, Header, Hash, Mask };
+
+/**
+ * Layout of the volatile fields blanked out by the MASK strategy
+ *
+ * Only directories have a layout of their own. The file record and the
+ * top-level keys list are ignored by default and never compared.
+ */
+enum class VolatileFields { None, Directory };
+
+/**
+ * Comparison strategy of every class
+ *
+ * Classes are given small integer ids when the table is filled, so the
+ * comparison loop dispatches on the id stored in ObjectInfo instead of
+ * comparing class names. Classes that are not in the table share id 0
+ * and the FULL strategy. The table must be filled before any file is
+ * scanned and is read-only afterwards, so it can be shared by threads.
+ */
+class StrategyTable {
+ public:
+  /**
+   * Constructor
+   * TDirectoryFile objects are skipped by default since their fUUID
+   * differs between any two files.
+   */
+  StrategyTable();
+
+  /**
+   * Set the strategy of a class
+   */
+  void set(const std::string &class_name, Strategy strategy);
+
+  /**
+   * Read strategies from a config file
+   *
+   * Every line holds a class name and a strategy (full, skip, header,
+   * hash or mask) separated by whitespace. Empty lines and lines
+   * starting with '#' are skipped. Throws on an unknown strategy.
+   */
+  void load(const std::string &fn);
+
+  /**
+   * Id of a class, 0 if it has no strategy of its own
+   */
+  Int_t class_id(const std::string &class_name) const {
+    auto it = ids_.find(class_name);
+    return it == ids_.end() ? 0 : it->second;
+  }
+
+  /// strategy of a class id
+  Strategy strategy(Int_t class_id) const { return strategies_[class_id]; }
+
+  /// volatile fields of a class id
+  VolatileFields volatile_fields(Int_t class_id) const { return fields_[class_id]; }
+
+ private:
+  std::unordered_map<std::string, Int_t> ids_;
+  std::vector<Strategy> strategies_;
+  std::vector<VolatileFields> fields_;
+};
+
+}  // namespace rootdiff
+
+#endif
@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+namespace rootdiff {
+
+/// pool owning the current thread, if it is a worker
+static thread_local ThreadPool *tl_pool = nullptr;
+/// index of the current thread in its pool
+static thread_local unsigned int tl_index = 0;
+
+ThreadPool::ThreadPool(unsigned int n_threads) {
+  if (n_threads == 0) n_threads = 1;
+  for (unsigned int i = 0; i < n_threads; i++) {
+    workers_.emplace_back(new Worker);
+  }
+  for (unsigned int i = 0; i < n_threads; i++) {
+    threads_.emplace_back(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto &t : threads_) t.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  unsigned int target = tl_index;
+  {
+    // Count the task before publishing it, a thief may take and finish
+    // it right away and wait() must not see pending_ drop to 0 meanwhile
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (tl_pool != this) target = next_++ % workers_.size();
+    queued_++;
+    pending_++;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mtx);
+    workers_[target]->tasks.push_back(std::move(task));
+  }
+  work_cv_.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mtx_);
+  done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+bool ThreadPool::take(unsigned int self, std::function<void()> &task) {
+  {
+    Worker &own = *workers_[self];
+    std::lock_guard<std::mutex> lock(own.mtx);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for (unsigned int i = 1; i < workers_.size(); i++) {
+    Worker &victim = *workers_[(self + i) % workers_.size()];
+    std::lock_guard<std::mutex> lock(victim.mtx);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::run(unsigned int self) {
+  tl_pool = this;
+  tl_index = self;
+
+  std::function<void()> task;
+  while (true) {
+    if (take(self, task)) {
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        queued_--;
+      }
+      task();
+      task = nullptr;
+      std::lock_guard<std::mutex> lock(mtx_);
+      if (--pending_ == 0) done_cv_.notify_all();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mtx_);
+    work_cv_.wait(lock, [this] { return stop_ or queued_ > 0; });
+    if (stop_ and queued_ == 0) return;
+  }
+}
+
+}  // namespace rootdiff
@@ -0,0 +1,84 @@
+#ifndef ROOT_DIFF_THREAD_POOL
+#define ROOT_DIFF_THREAD_POOL
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rootdiff {
+
+/**
+ * A work-stealing thread pool
+ *
+ * Every worker owns a queue of tasks. A worker pops the newest task from
+ * its own queue and, when that runs dry, steals the oldest task from
+ * the queue of another worker. Tasks submitted from inside a worker go
+ * to that worker's queue so that a task splitting itself into pieces
+ * keeps the pieces local until somebody else is idle.
+ */
+class ThreadPool {
+ public:
+  /**
+   * Constructor
+   * Start the input number of worker threads (at least one).
+   */
+  ThreadPool(unsigned int n_threads);
+
+  /**
+   * Destructor
+   * Wait for every task to finish and join the workers.
+   */
+  ~ThreadPool();
+
+  /**
+   * Queue a task for execution
+   */
+  void submit(std::function<void()> task);
+
+  /**
+   * Block until every submitted task, including the tasks they
+   * submitted in turn, has finished
+   */
+  void wait();
+
+  /**
+   * Number of worker threads
+   */
+  unsigned int size() const { return workers_.size(); }
+
+ private:
+  /// queue of tasks owned by one worker
+  struct Worker {
+    std::deque<std::function<void()>> tasks;
+    std::mutex mtx;
+  };
+
+  /// take a task from our own queue or steal one from another queue
+  bool take(unsigned int self, std::function<void()> &task);
+
+  /// main loop of a worker thread
+  void run(unsigned int self);
+
+ private:
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+  /// round-robin counter for tasks submitted from outside the pool
+  unsigned int next_{0};
+  /// guards the counters below
+  std::mutex mtx_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  /// tasks sitting in a queue
+  long queued_{0};
+  /// tasks queued or running
+  long pending_{0};
+  bool stop_{false};
+};
+
+}  // namespace rootdiff
+
+#endif
@@ -5,7 +5,7 @@
 #include <iostream>
 
 /*
- * A timer for measuring the performance on millisecond
+ * A timer for measuring the performance, elapsed time is in seconds
  */
 
 class Timer {
@@ -1,8 +1,16 @@
+#include <getopt.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <memory>
 #include <string>
+#include <thread>
 
-#include "root_file_comparator.h"
+#include "DirComparer.h"
+#include "FollowComparer.h"
+#include "MergeVerifier.h"
+#include "Progress.h"
+#include "FileComparer.h"
 
 static void get_ignored_classes(std::set<std::string> &ignored_classes,
                                 char *ignored_classes_fn) {
@@ -25,6 +33,45 @@ static inline void usage() {
        << std::endl;
   std::cout << "-m         Specify compare mode (i.e. CC, UC)." << std::endl;
   std::cout << "-d         Enable debug mode." << std::endl;
+  std::cout << "-s         Path to the user specified file, which sets the "
+          "comparison strategy (full, skip, header, hash, mask) of classes"
+       << std::endl;
+  std::cout << "-j         Number of worker threads (default: number of cores). "
+          "Large files are scanned in parallel, --dirs compares files in parallel."
+       << std::endl;
+  std::cout << "--tolerance ABS[:REL]" << std::endl;
+  std::cout << "           Accept float/double branches whose values agree within "
+          "|a-b| <= ABS + REL*max(|a|,|b|)"
+       << std::endl;
+  std::cout << "--follow   Compare two ROOT files while they are being written, "
+          "report the first difference right away"
+       << std::endl;
+  std::cout << "--io BACKEND" << std::endl;
+  std::cout << "           Read the files with tfile (default), pread, mmap or "
+          "async I/O"
+       << std::endl;
+  std::cout << "--io-latency MS" << std::endl;
+  std::cout << "           Add MS milliseconds to every read to simulate "
+          "remote storage"
+       << std::endl;
+  std::cout << "--io-bandwidth MBPS" << std::endl;
+  std::cout << "           Cap the reads of every file at MBPS MB/s to simulate "
+          "remote storage"
+       << std::endl;
+  std::cout << "--cache-mb MB" << std::endl;
+  std::cout << "           Memory cap of the cache of decompressed payload hashes "
+          "and verdicts shared by all comparisons (default: 64, 0 disables it)"
+       << std::endl;
+  std::cout << "--progress[=FD]" << std::endl;
+  std::cout << "           Write a JSON line with the progress and the provisional "
+          "agreement level every second to FD (default: 2, stderr)"
+       << std::endl;
+  std::cout << "--merged   Verify that the first ROOT file is the hadd output "
+          "of the others"
+       << std::endl;
+  std::cout << "--dirs     Compare two directories of ROOT files, pairing the "
+          "files by relative path"
+       << std::endl;
   std::cout << std::endl;
 }
 
@@ -38,6 +85,15 @@ int main(int argc, char *argv[]) {
   std::string log_fn = std::string("root_diff.log");
   char *fn1 = NULL, *fn2 = NULL;
   char *ignored_classes_fn = NULL;
+  char *strategies_fn = NULL;
+  bool dirs_mode = false;
+  bool follow_mode = false;
+  bool merged_mode = false;
+  bool tolerant = false;
+  double abs_eps = 0., rel_eps = 0.;
+  rootdiff::IOConfig io_config;
+  int progress_fd = -1;
+  unsigned int n_threads = std::thread::hardware_concurrency();
 
   // Insert three types of class that will be ignored
   std::set<std::string> ignored_classes;
@@ -53,7 +109,19 @@ int main(int argc, char *argv[]) {
   int num_root_files = 0;
   int rc = 0;
 
-  while ((opt = getopt(argc, argv, "hf:m:l:c:d")) != -1) {
+  static struct option long_options[] = {
+      {"dirs", no_argument, NULL, 'D'},
+      {"tolerance", required_argument, NULL, 'T'},
+      {"follow", no_argument, NULL, 'F'},
+      {"merged", no_argument, NULL, 'M'},
+      {"cache-mb", required_argument, NULL, 'C'},
+      {"io", required_argument, NULL, 'I'},
+      {"io-latency", required_argument, NULL, 'L'},
+      {"io-bandwidth", required_argument, NULL, 'B'},
+      {"progress", optional_argument, NULL, 'P'},
+      {NULL, 0, NULL, 0}};
+
+  while ((opt = getopt_long(argc, argv, "hf:m:l:c:s:dj:", long_options, NULL)) != -1) {
     switch (opt) {
       case 'l':
         log_fn = optarg;
@@ -76,6 +144,55 @@ int main(int argc, char *argv[]) {
         debug_mode = true;
         break;
 
+      case 's':
+        strategies_fn = optarg;
+        break;
+
+      case 'j':
+        n_threads = atoi(optarg);
+        break;
+
+      case 'D':
+        dirs_mode = true;
+        break;
+
+      case 'F':
+        follow_mode = true;
+        break;
+
+      case 'M':
+        merged_mode = true;
+        break;
+
+      case 'C':
+        rootdiff::ContentCache::instance().set_capacity(
+            (Long64_t)(strtod(optarg, NULL) * (1 << 20)));
+        break;
+
+      case 'T': {
+        char *rel_str = NULL;
+        tolerant = true;
+        abs_eps = strtod(optarg, &rel_str);
+        rel_eps = (*rel_str == ':') ? strtod(rel_str + 1, NULL) : 0.;
+        break;
+      }
+
+      case 'I':
+        io_config.type = rootdiff::io_backend_type(optarg);
+        break;
+
+      case 'L':
+        io_config.latency_ms = strtod(optarg, NULL);
+        break;
+
+      case 'B':
+        io_config.bandwidth_mbps = strtod(optarg, NULL);
+        break;
+
+      case 'P':
+        progress_fd = optarg ? atoi(optarg) : 2;
+        break;
+
       default:
         usage();
         return 1;
@@ -83,9 +200,96 @@ int main(int argc, char *argv[]) {
   }
 
   rootdiff::FileComparer comparer(debug_mode);
+  comparer.set_io(io_config);
+  comparer.set_scan_threads(n_threads);
+  if (tolerant) {
+    comparer.set_tolerance(abs_eps, rel_eps);
+  }
+  if (strategies_fn) {
+    comparer.strategies().load(strategies_fn);
+  }
+
+  std::unique_ptr<rootdiff::Progress> progress;
+  if (progress_fd >= 0) {
+    progress.reset(new rootdiff::Progress(progress_fd));
+    comparer.set_progress(progress.get());
+  }
+
+  if (dirs_mode) {
+    struct stat st;
+    if (argc - optind != 2) {
+      std::cout << "Please specifiy two directories." << std::endl;
+      return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+      if (stat(argv[i], &st) != 0 or !S_ISDIR(st.st_mode)) {
+        std::cout << argv[i] << " is not an accessible directory." << std::endl;
+        return 1;
+      }
+    }
+
+    rootdiff::DirComparer dir_comparer(comparer, n_threads);
+    std::vector<rootdiff::FileReport> reports;
+    double seconds = 0.;
+    al = dir_comparer.comp(argv[optind], argv[optind + 1], compare_mode,
+                           log_fn, ignored_classes, reports, seconds);
+    if (progress) progress->finish(al);
+
+    std::cout << "-----------------------------------------------------------" << std::endl;
+    std::cout << "directory 1: " << argv[optind] << std::endl;
+    std::cout << "directory 2: " << argv[optind + 1] << std::endl;
+    rootdiff::DirComparer::report(std::cout, reports, seconds);
+    if (al == rootdiff::AgreeLevel::Not_eq) {
+      std::cout << "directory 1 is NOT EQUAL to directory 2." << std::endl;
+    } else {
+      std::cout << "directory 1 is EQUAL to directory 2." << std::endl;
+      std::cout << "The agreement level is " << rootdiff::agree_level_name(al) << std::endl;
+    }
+    std::cout << "Details can be found in " << log_fn << std::endl;
+    std::cout << "-----------------------------------------------------------" << std::endl;
+    return 0;
+  }
+
+  if (merged_mode) {
+    if (argc - optind < 2) {
+      std::cout << "Please specifiy the merged root file and its inputs." << std::endl;
+      return 1;
+    }
+    std::vector<std::string> input_fns;
+    for (int i = optind; i < argc; i++) {
+      if (access(argv[i], R_OK) != 0) {
+        std::cout << argv[i] << " is not accessible." << std::endl;
+        return 1;
+      }
+      if (i > optind) input_fns.push_back(argv[i]);
+    }
+
+    rootdiff::MergeVerifier verifier(comparer, n_threads);
+    bool ok = verifier.comp(argv[optind], input_fns, log_fn);
+    if (progress) {
+      progress->finish(ok ? rootdiff::AgreeLevel::Exact_eq
+                          : rootdiff::AgreeLevel::Not_eq);
+    }
+
+    std::cout << "-----------------------------------------------------------" << std::endl;
+    std::cout << "merged file: " << argv[optind] << std::endl;
+    for (auto const &fn : input_fns) {
+      std::cout << "input file: " << fn << std::endl;
+    }
+    if (ok) {
+      std::cout << "The merged file holds exactly the data of its inputs." << std::endl;
+    } else {
+      std::cout << "The merged file does NOT hold exactly the data of its inputs." << std::endl;
+    }
+    std::cout << "Only the TBaskets and histograms are checked." << std::endl;
+    std::cout << "Details can be found in " << log_fn << std::endl;
+    std::cout << "-----------------------------------------------------------" << std::endl;
+    return 0;
+  }
 
   for (; optind < argc; optind++) {
-    rc = access(argv[optind], R_OK);
+    // files being followed may not have been created yet
+    rc = follow_mode ? 0 : access(argv[optind], R_OK);
     if (rc == 0 && num_root_files == 0) {
       fn1 = strdup(argv[optind]);
     }
@@ -112,13 +316,22 @@ int main(int argc, char *argv[]) {
   }
 
   // Compare two root files
-  al = comparer.comp(fn1, fn2, compare_mode.c_str(), log_fn.c_str(),
-                     ignored_classes);
+  if (follow_mode) {
+    rootdiff::FollowComparer follower(comparer, debug_mode);
+    al = follower.comp(fn1, fn2, compare_mode, log_fn, ignored_classes);
+  } else {
+    al = comparer.comp(fn1, fn2, compare_mode.c_str(), log_fn.c_str(),
+                       ignored_classes);
+  }
+  if (progress) progress->finish(al);
 
   // Check the agreement level
   switch (al) {
     case rootdiff::AgreeLevel::Logic_eq:
       break;
+    case rootdiff::AgreeLevel::Tolerant_eq:
+      agree_lv = "TOLERANT";
+      break;
     case rootdiff::AgreeLevel::Strict_eq:
       agree_lv = "STRICT";
       break;
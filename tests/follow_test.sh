@@ -0,0 +1,83 @@
+#!/bin/sh
+# Follow ROOT files while they are being written:
+# 1. two diverging files, the first difference must be reported before
+#    the writers are done
+# 2. a file and a copy holding two of its objects in the other order,
+#    no difference must be reported and the files must be equal
+#
+# Use: tests/follow_test.sh [path/to/root_diff]
+
+root_diff=${1:-bin/root_diff}
+samples=$(dirname "$0")/../sample_root_files
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Copy the first bytes of a file and, once followed, the rest 2000 bytes
+# at a time, one chunk every half second
+write_slowly()
+{
+    size=$(wc -c < "$1")
+    head -c "$3" "$1" > "$2"
+    sleep 1.5
+    off=$3
+    while [ $off -lt "$size" ]
+    do
+        tail -c +$((off + 1)) "$1" | head -c 2000 >> "$2"
+        off=$((off + 2000))
+        sleep 0.5
+    done
+}
+
+# Follow $1 and $2 written with a first chunk of $3 bytes into $tmp/out,
+# set early if the first difference was printed before the writers were done
+follow()
+{
+    rm -f "$tmp/1.root" "$tmp/2.root"
+    "$root_diff" --follow -m CC -l "$tmp/follow.log" "$tmp/1.root" "$tmp/2.root" > "$tmp/out" &
+    follower=$!
+    write_slowly "$1" "$tmp/1.root" "$3" &
+    writer_1=$!
+    write_slowly "$2" "$tmp/2.root" "$3" &
+    writer_2=$!
+    wait $writer_1 $writer_2
+
+    early=no
+    grep -q "First difference" "$tmp/out" && early=yes
+    wait $follower
+    cat "$tmp/out"
+}
+
+# r1 and r2 hold the same objects with different contents and lengths
+follow "$samples/r1.root" "$samples/r2.root" 2000
+if [ $early = no ]
+then
+    echo "FAIL the first difference was not reported while the files were written"
+    exit 1
+fi
+if ! grep -q "NOT EQUAL" "$tmp/out"
+then
+    echo "FAIL the diverging files were not found NOT EQUAL"
+    exit 1
+fi
+echo "PASS the first difference was reported while the files were written"
+
+# Swap the TLorentzVector at 313 and the TH1F at 518 of r1 around the
+# free gap between them, the first chunk then ends after the first of
+# them in both files
+python3 - "$samples/r1.root" "$tmp/swapped.root" <<'EOF'
+import struct, sys
+d = bytearray(open(sys.argv[1], 'rb').read())
+a, len_a, b, len_b = 313, 148, 518, 440
+rec_a, gap, rec_b = d[a:a + len_a], d[a + len_a:b], d[b:b + len_b]
+rec_b[18:22] = struct.pack('>i', a)
+rec_a[18:22] = struct.pack('>i', a + len_b + len(gap))
+d[a:b + len_b] = rec_b + gap + rec_a
+open(sys.argv[2], 'wb').write(d)
+EOF
+follow "$samples/r1.root" "$tmp/swapped.root" 800
+if grep -q "First difference" "$tmp/out" || ! grep -q "is EQUAL" "$tmp/out"
+then
+    echo "FAIL objects written in another order were reported as a difference"
+    exit 1
+fi
+echo "PASS objects written in another order were not reported as a difference"
@@ -0,0 +1,118 @@
+/*
+ * Checks of the float/double comparison kernels of --tolerance
+ *
+ * Arrays shorter than one AVX2 vector (8 floats, 4 doubles) are compared
+ * by the scalar kernel only, longer arrays by the AVX2 kernel when the CPU
+ * supports it.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "NumericCmp.h"
+
+using rootdiff::Deviation;
+
+static int n_failed = 0;
+
+template <typename T>
+static std::vector<unsigned char> to_be(const std::vector<T> &values) {
+  std::vector<unsigned char> bytes(values.size() * sizeof(T));
+  for (std::size_t i = 0; i < values.size(); i++) {
+    unsigned char raw[sizeof(T)];
+    memcpy(raw, &values[i], sizeof(T));
+    for (std::size_t j = 0; j < sizeof(T); j++) {
+      bytes[i * sizeof(T) + j] = raw[sizeof(T) - 1 - j];
+    }
+  }
+  return bytes;
+}
+
+/**
+ * Is a reported maximum deviation the expected one? Float kernels may
+ * divide in single precision.
+ */
+static bool close(double got, double expected) {
+  return std::fabs(got - expected) <= 1e-6 * std::fabs(expected);
+}
+
+template <typename T>
+static void check(const char *what, const std::vector<T> &a,
+                  const std::vector<T> &b, double abs_eps, double rel_eps,
+                  Long64_t expected_outside, double expected_max_abs = 0.,
+                  double expected_max_rel = 0.) {
+  std::vector<unsigned char> ba = to_be(a), bb = to_be(b);
+  Deviation dev;
+  if (sizeof(T) == sizeof(float)) {
+    rootdiff::compare_float_be(ba.data(), bb.data(), a.size(), abs_eps,
+                               rel_eps, dev);
+  } else {
+    rootdiff::compare_double_be(ba.data(), bb.data(), a.size(), abs_eps,
+                                rel_eps, dev);
+  }
+  bool ok = dev.n_outside == expected_outside and
+            dev.n_values == (Long64_t)a.size() and
+            close(dev.max_abs, expected_max_abs) and
+            close(dev.max_rel, expected_max_rel);
+  if (!ok) n_failed++;
+  std::cout << (ok ? "PASS " : "FAIL ") << what << " (" << a.size()
+            << " values, abs " << abs_eps << ", rel " << rel_eps << "): "
+            << dev.n_outside << " outside, expected " << expected_outside
+            << ", max deviation " << dev.max_abs << " / " << dev.max_rel
+            << ", expected " << expected_max_abs << " / " << expected_max_rel
+            << std::endl;
+}
+
+/**
+ * Identical non-finite values agree, a changed value is caught
+ */
+template <typename T>
+static void check_type(const char *type, std::size_t n) {
+  const T nan = std::numeric_limits<T>::quiet_NaN();
+  const T inf = std::numeric_limits<T>::infinity();
+
+  std::vector<T> a(n, (T)1.5);
+  a[0] = nan;
+  a[1] = inf;
+  a[2] = -inf;
+  std::string name = std::string(type) + " identical NaN and infinities";
+  check<T>(name.c_str(), a, a, 0., 1e-6, 0);
+  check<T>(name.c_str(), a, a, 1e-6, 0., 0);
+  check<T>(name.c_str(), a, a, 0., 0., 0);
+
+  std::vector<T> c(n, (T)1.5), b = c;
+  b[n - 1] = (T)1.6;
+  double off = (double)b[n - 1] - 1.5;
+  name = std::string(type) + " one value off";
+  check<T>(name.c_str(), c, b, 1e-3, 0., 1, off, off / b[n - 1]);
+  check<T>(name.c_str(), c, b, 0.2, 0., 0, off, off / b[n - 1]);
+
+  // The largest deviation is not the largest relative one
+  b = c;
+  b[1] = (T)1.75;
+  b[n - 1] = (T)-0.25;
+  c[n - 1] = (T)-0.125;
+  name = std::string(type) + " largest of several deviations";
+  check<T>(name.c_str(), c, b, 0.3, 0., 0, 0.25, 0.5);
+
+  b = a;
+  b[0] = (T)1.5;
+  name = std::string(type) + " NaN against a number";
+  check<T>(name.c_str(), a, b, 1., 1., 1);
+}
+
+int main() {
+  std::cout << "AVX2 kernels: " << (rootdiff::numeric_cmp_avx2() ? "yes" : "no")
+            << std::endl;
+
+  check_type<float>("float", 3);
+  check_type<float>("float", 16);
+  check_type<double>("double", 3);
+  check_type<double>("double", 8);
+
+  return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,85 @@
+#!/bin/sh
+# Compare a ROOT file with a copy whose double branches were rounded:
+# 1. the rounded baskets compress to other lengths, they must still be
+#    paired and found TOLERANT in both modes
+# 2. without --tolerance, or with a tolerance below the rounding, the
+#    files must not be found TOLERANT
+#
+# Use: tests/tolerance_test.sh [path/to/root_diff]
+
+root_diff=${1:-bin/root_diff}
+samples=$(dirname "$0")/../sample_root_files
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# Round the values of every basket of t1 to 36 bits of mantissa and
+# compress it again. The shorter baskets stay in place, each followed by
+# a gap over the bytes it no longer uses, so that no offset changes.
+python3 - "$samples/t1.root" "$tmp/rounded.root" <<'EOF'
+import struct, sys, zlib
+d = bytearray(open(sys.argv[1], 'rb').read())
+version, begin = struct.unpack('>ii', d[4:12])
+end = struct.unpack('>q' if version > 1000000 else '>i', d[12:20 if version > 1000000 else 16])[0]
+cur, n_rounded = begin, 0
+while cur < end:
+    nbytes = struct.unpack('>i', d[cur:cur + 4])[0]
+    if nbytes < 0:
+        cur -= nbytes
+        continue
+    key_version, obj_len = struct.unpack('>hi', d[cur + 4:cur + 10])
+    key_len = struct.unpack('>h', d[cur + 14:cur + 16])[0]
+    off = cur + 18 + (16 if key_version > 1000 else 8)
+    class_name = bytes(d[off + 1:off + 1 + d[off]])
+    block = d[cur + key_len:cur + nbytes]
+    if class_name != b'TBasket' or block[:2] != b'ZL':
+        cur += nbytes
+        continue
+
+    # fLast, the end of the entries, is the last int of the key before
+    # its flag byte and counts from the start of the key
+    last = struct.unpack('>i', d[cur + key_len - 5:cur + key_len - 1])[0]
+    raw = bytearray(zlib.decompress(bytes(block[9:])))
+    for i in range(0, last - key_len - 7, 8):
+        raw[i + 6:i + 8] = b'\0\0'
+    z = zlib.compress(bytes(raw), 9)
+    new_block = block[:3] + struct.pack('<i', len(z))[:3] + struct.pack('<i', len(raw))[:3] + z
+    new_nbytes = key_len + len(new_block)
+    if new_nbytes + 4 > nbytes:
+        sys.exit('rounded basket at %d does not fit' % cur)
+    d[cur:cur + 4] = struct.pack('>i', new_nbytes)
+    d[cur + key_len:cur + new_nbytes] = new_block
+    d[cur + new_nbytes:cur + new_nbytes + 4] = struct.pack('>i', new_nbytes - nbytes)
+    n_rounded += 1
+    cur += nbytes
+if not n_rounded:
+    sys.exit('no basket rounded')
+open(sys.argv[2], 'wb').write(d)
+EOF
+[ $? -eq 0 ] || { echo "FAIL the rounded copy could not be written"; exit 1; }
+
+for mode in CC UC
+do
+    "$root_diff" -m $mode --tolerance 0:1e-9 -l "$tmp/$mode.log" "$samples/t1.root" "$tmp/rounded.root" > "$tmp/out"
+    cat "$tmp/out"
+    if ! grep -q "agreement level is TOLERANT" "$tmp/out"
+    then
+        echo "FAIL the rounded baskets were not found TOLERANT in $mode mode"
+        exit 1
+    fi
+    if ! grep -q "max relative deviation [1-9]" "$tmp/$mode.log"
+    then
+        echo "FAIL the deviations of the rounded branches were not logged in $mode mode"
+        exit 1
+    fi
+done
+echo "PASS the rounded baskets were found TOLERANT"
+
+"$root_diff" -m CC -l "$tmp/strict.log" "$samples/t1.root" "$tmp/rounded.root" > "$tmp/out"
+"$root_diff" -m CC --tolerance 0:1e-14 -l "$tmp/tight.log" "$samples/t1.root" "$tmp/rounded.root" >> "$tmp/out"
+if grep -q "TOLERANT" "$tmp/out"
+then
+    cat "$tmp/out"
+    echo "FAIL the rounded baskets were found TOLERANT without a wide enough tolerance"
+    exit 1
+fi
+echo "PASS the rounded baskets were not found TOLERANT without a wide enough tolerance"